@@ -0,0 +1,98 @@
+//
+// Created by Peyman Mortazavi on 2019-05-02.
+//
+
+#ifndef SUSPIRIA_BUFFER_POOL_H
+#define SUSPIRIA_BUFFER_POOL_H
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "susperia/internal/utility.h"
+
+
+namespace suspiria::networking {
+
+  /**
+   * A pool of fixed size slabs that connections borrow while they have data to read and give back as soon as the
+   * data is handed to their protocol. Idle connections (e.g. keep-alive connections waiting for the next request) do
+   * not hold on to any slab this way, so memory usage follows the number of busy connections instead of open ones.
+   */
+  class buffer_pool {
+  public:
+    static constexpr size_t default_slab_size = 16 * 1024;
+    static constexpr size_t default_max_idle_slabs = 64;
+
+    /**
+     * @param slab_size Size of every slab handed out by the pool.
+     * @param max_idle_slabs Number of returned slabs kept around for reuse, the rest are freed.
+     * @param thread_safe Whether the pool is shared between threads. Pools owned by a single thread skip locking.
+     */
+    explicit buffer_pool(
+      size_t slab_size=default_slab_size, size_t max_idle_slabs=default_max_idle_slabs, bool thread_safe=true
+    ) : slab_size_(slab_size), max_idle_slabs_(max_idle_slabs), mutex_(thread_safe) {}
+    buffer_pool(const buffer_pool&) = delete;
+
+    size_t slab_size() const noexcept { return slab_size_; }
+
+    /**
+     * Borrows a slab of slab_size() bytes from the pool, allocating a new one only if there is no idle slab left.
+     */
+    std::unique_ptr<char[]> acquire() {
+      {
+        std::lock_guard<utility::optional_mutex> lock{mutex_};
+        if (!idle_slabs_.empty()) {
+          auto slab = std::move(idle_slabs_.back());
+          idle_slabs_.pop_back();
+          return slab;
+        }
+      }
+      return std::unique_ptr<char[]>(new char[slab_size_]);
+    }
+
+    /**
+     * Returns a slab to the pool. Slabs beyond the idle limit are freed so a burst doesn't pin memory forever.
+     */
+    void release(std::unique_ptr<char[]>&& slab) {
+      std::lock_guard<utility::optional_mutex> lock{mutex_};
+      if (idle_slabs_.size() < max_idle_slabs_) idle_slabs_.emplace_back(std::move(slab));
+    }
+
+  private:
+    size_t slab_size_;
+    size_t max_idle_slabs_;
+    utility::optional_mutex mutex_;
+    std::vector<std::unique_ptr<char[]>> idle_slabs_;
+  };
+
+
+  /**
+   * Keeps track of how much a connection usually reads at once. Reads that fill up the whole window grow it (up to a
+   * slab) and reads that barely use it shrink it back, so the next read asks for about what the peer tends to send.
+   */
+  class read_size_hint {
+  public:
+    static constexpr size_t min_read_size = 512;
+
+    explicit read_size_hint(size_t max_read_size) : max_(max_read_size), size_(std::min(size_t{4096}, max_read_size)) {}
+
+    size_t size() const noexcept { return size_; }
+
+    void update(size_t length) noexcept {
+      if (length >= size_) {
+        size_ = std::min(size_ * 2, max_);
+      } else if (length < size_ / 4 && size_ > min_read_size) {
+        size_ /= 2;
+      }
+    }
+
+  private:
+    size_t max_;
+    size_t size_;
+  };
+
+}
+
+#endif //SUSPIRIA_BUFFER_POOL_H
@@ -0,0 +1,95 @@
+//
+// Created by Peyman Mortazavi on 2019-05-09.
+//
+
+#ifndef SUSPIRIA_HANDLER_MEMORY_H
+#define SUSPIRIA_HANDLER_MEMORY_H
+
+#include <type_traits>
+#include <utility>
+
+#include <asio.hpp>
+
+
+namespace suspiria::networking {
+
+  /**
+   * Memory for the pending operation of one kind (e.g. reads) of a connection. Asio allocates every pending operation
+   * and the wrappers around its completion through the handler's allocator, since a connection has at most one
+   * operation of each kind in flight, a single block per kind covers them and keeps the heap out of the hot path.
+   */
+  class handler_memory {
+  public:
+    handler_memory() = default;
+    handler_memory(const handler_memory&) = delete;
+
+    void* allocate(size_t size) {
+      if (!in_use_ && size <= sizeof(storage_)) {
+        in_use_ = true;
+        return &storage_;
+      }
+      return ::operator new(size);
+    }
+
+    void deallocate(void* pointer) {
+      if (pointer == &storage_) {
+        in_use_ = false;
+      } else {
+        ::operator delete(pointer);
+      }
+    }
+
+  private:
+    std::aligned_storage_t<512> storage_;
+    bool in_use_ = false;
+  };
+
+
+  template<typename T>
+  class handler_allocator {
+  public:
+    typedef T value_type;
+
+    explicit handler_allocator(handler_memory& memory) : memory_(memory) {}
+    template<typename U> handler_allocator(const handler_allocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(memory_.allocate(sizeof(T) * count)); }
+    void deallocate(T* pointer, size_t) { memory_.deallocate(pointer); }
+
+    bool operator==(const handler_allocator& other) const noexcept { return &memory_ == &other.memory_; }
+    bool operator!=(const handler_allocator& other) const noexcept { return &memory_ != &other.memory_; }
+
+  private:
+    template<typename> friend class handler_allocator;
+    handler_memory& memory_;
+  };
+
+
+  /**
+   * Wraps a completion handler so asio allocates everything it needs for it from the given handler_memory.
+   */
+  template<typename Handler>
+  class memory_bound_handler {
+  public:
+    typedef handler_allocator<Handler> allocator_type;
+
+    memory_bound_handler(handler_memory& memory, Handler handler) : memory_(memory), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(memory_); }
+
+    template<typename... Args> void operator()(Args&&... args) { handler_(std::forward<Args>(args)...); }
+
+  private:
+    handler_memory& memory_;
+    Handler handler_;
+  };
+
+
+  template<typename Handler>
+  memory_bound_handler<std::decay_t<Handler>> bind_memory(handler_memory& memory, Handler&& handler) {
+    return memory_bound_handler<std::decay_t<Handler>>(memory, std::forward<Handler>(handler));
+  }
+
+}
+
+#endif //SUSPIRIA_HANDLER_MEMORY_H
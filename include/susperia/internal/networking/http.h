@@ -5,13 +5,21 @@
 #ifndef SUSPIRIA_HTTP_H
 #define SUSPIRIA_HTTP_H
 
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <memory_resource>
 #include <unordered_map>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 #include <asio.hpp>
 
 #include "routing/routing.h"
+#include "http_method.h"
 #include "ip.h"
 #include "protocol.h"
 
@@ -20,58 +28,220 @@ namespace suspiria {
 
   namespace networking {
 
-    enum HttpMethod : unsigned int {
-      DELETE = 0,
-      GET = 1,
-      HEAD = 2,
-      POST = 3,
-      PUT = 4,
-    };
-
     enum HttpStatus {
       OK = 200,
       NotFound = 404,
       BadRequest = 400,
+      MethodNotAllowed = 405,
+      PayloadTooLarge = 413,
+    };
+
+
+    /**
+     * Request headers kept in a small flat list of views, lookups are case insensitive. The views point into the
+     * connection's receive buffer, or into the protocol's per request arena for headers that arrived in pieces, so
+     * nothing gets allocated for headers nobody reads. They are only valid while the request is being handled.
+     */
+    class HttpHeaders {
+    public:
+      struct header {
+        std::string_view name;
+        std::string_view value;
+      };
+      typedef std::vector<header>::iterator iterator;
+      typedef std::vector<header>::const_iterator const_iterator;
+
+      const header* find(std::string_view name) const noexcept;
+      bool contains(std::string_view name) const noexcept { return this->find(name) != nullptr; }
+
+      std::string_view get(std::string_view name, std::string_view fallback={}) const noexcept {
+        auto item = this->find(name);
+        return item ? item->value : fallback;
+      }
+      std::string_view operator[](std::string_view name) const noexcept { return this->get(name); }
+
+      void add(std::string_view name, std::string_view value={}) { headers_.emplace_back(header{name, value}); }
+      header& back() noexcept { return headers_.back(); }
+      void clear() noexcept { headers_.clear(); }  // keeps the capacity around for the next request.
+
+      size_t size() const noexcept { return headers_.size(); }
+      bool empty() const noexcept { return headers_.empty(); }
+      iterator begin() noexcept { return headers_.begin(); }
+      iterator end() noexcept { return headers_.end(); }
+      const_iterator begin() const noexcept { return headers_.begin(); }
+      const_iterator end() const noexcept { return headers_.end(); }
+
+    private:
+      std::vector<header> headers_;
+    };
+
+
+    /**
+     * Where a request body lives: small allocations come from the request's arena and larger ones from the heap. The
+     * arena never gives memory back before the request is done, so a large body growing in it would leave each of its
+     * smaller copies behind and take up the slab the rest of the request needs.
+     */
+    class body_resource : public std::pmr::memory_resource {
+    public:
+      static constexpr size_t heap_threshold = 4 * 1024;
+
+      std::pmr::memory_resource* arena() const noexcept { return arena_; }
+      void set_arena(std::pmr::memory_resource* arena) noexcept { arena_ = arena; }
+
+    protected:
+      void* do_allocate(size_t bytes, size_t alignment) override {
+        return this->pick(bytes)->allocate(bytes, alignment);
+      }
+      void do_deallocate(void* pointer, size_t bytes, size_t alignment) override {
+        this->pick(bytes)->deallocate(pointer, bytes, alignment);
+      }
+      bool do_is_equal(const std::pmr::memory_resource& another) const noexcept override { return this == &another; }
+
+    private:
+      std::pmr::memory_resource* pick(size_t bytes) const noexcept {
+        return bytes > heap_threshold ? std::pmr::new_delete_resource() : arena_;
+      }
+
+      std::pmr::memory_resource* arena_ = std::pmr::new_delete_resource();
     };
 
 
+    class HttpResponse;
+    class http_delegate;
+    class routing_delegate;
+
     class HttpRequest {
     public:
+      typedef std::function<void(std::string_view chunk)> BodySink;
+
       explicit HttpRequest(tcp_connection& connection) : connection_(connection) {}
       friend class HttpResponse;
-      std::string uri;
+      friend class routing_delegate;
+      std::string_view uri;  // like the headers, only valid while the request is being handled.
       HttpMethod method;
       bool keep_alive = false;
-      std::unordered_map<std::string, std::string> headers;
+      HttpHeaders headers;
+
+    private:
+      body_resource body_resource_;  // ahead of the body, which allocates from it.
 
-      void reset() {
-        uri.clear();
+    public:
+      std::pmr::string body{&body_resource_};  // the whole body, unless it is streamed to a sink. See body_resource.
+      RouteParams params;  // the parameters of the route when a routing_delegate handles the request, views like uri.
+
+      tcp_connection& connection() noexcept { return connection_; }
+
+      /**
+       * Streams the body to the given sink chunk by chunk as it arrives instead of buffering it in the body field.
+       * Only has an effect when called from http_delegate::headers_received(). The sink may pause reading on the
+       * connection to push back on the client, in which case no more chunks arrive after the current read is handled
+       * until reading is resumed. The body timeout keeps running meanwhile, unless the sink clears the read timeout of
+       * the connection, it starts over with the next chunk.
+       */
+      void stream_body(BodySink sink) { body_sink_ = std::move(sink); }
+      bool is_body_streamed() const noexcept { return static_cast<bool>(body_sink_); }
+
+      /**
+       * The arena of the request, it is cleared once the request is handled and its response is sent.
+       */
+      std::pmr::memory_resource* resource() const noexcept { return resource_; }
+
+      /**
+       * Makes a response that lives entirely in the request's arena, the response itself as well as its headers and
+       * body. Responses made this way don't touch the heap unless they outgrow the arena.
+       */
+      template<typename Response=HttpResponse, typename... Args>
+      std::unique_ptr<Response> make_response(Args&&... args) {
+        return std::unique_ptr<Response>(new (resource_) Response(resource_, std::forward<Args>(args)...));
+      }
+
+      void append_body(std::string_view chunk) {
+        if (body_sink_) {
+          body_sink_(chunk);
+        } else {
+          body.append(chunk);
+        }
+      }
+
+      void reset(std::pmr::memory_resource* resource=std::pmr::get_default_resource()) {
+        resource_ = resource;
+        uri = {};
         keep_alive = false;
         headers.clear();
+        body = std::pmr::string(&body_resource_);  // gives the memory back to the arena it came from first.
+        body_resource_.set_arena(resource);
+        body_sink_ = nullptr;
+        params.clear();
+        route_ = nullptr;
+        route_snapshot_ = nullptr;
+        route_uri_ = nullptr;
       }
-      
+
     private:
       tcp_connection& connection_;
+      std::pmr::memory_resource* resource_ = std::pmr::get_default_resource();
+      BodySink body_sink_;
+      std::shared_ptr<http_delegate> route_;  // the handler routing_delegate resolved the request to.
+      std::shared_ptr<const Router<http_delegate>> route_snapshot_;  // the table the params point into.
+      HttpMethods route_allowed_;
+      const char* route_uri_ = nullptr;  // where the uri was when it got resolved, the params point into it.
     };
 
 
     class HttpResponse {
     public:
       HttpStatus status = HttpStatus::OK;
-      std::unordered_map<std::string, std::string> headers;
+      std::pmr::unordered_map<std::pmr::string, std::pmr::string> headers;
+      std::pmr::string body;
 
+      HttpResponse() = default;
+      explicit HttpResponse(std::pmr::memory_resource* resource) : headers(resource), body(resource) {}
       virtual ~HttpResponse() {}
 
-      void write(HttpRequest& request);
+      /**
+       * Responses remember the memory resource they were allocated from, see HttpRequest::make_response().
+       */
+      static void* operator new(size_t size);
+      static void* operator new(size_t size, std::pmr::memory_resource* resource);
+      static void operator delete(void* pointer);
+      static void operator delete(void* pointer, std::pmr::memory_resource* resource);
+
+      /**
+       * Appends the buffers that make up the response to the given list: the status line, every piece of every header
+       * and the body, each one as its own buffer so nothing gets concatenated. The buffers point into this response,
+       * so it has to outlive the write. A Content-Length header, whatever its case, is only added if there's none.
+       * @param with_body false for responses to HEAD requests: they get the Content-Length of their body, the one a
+       * GET would have, but not the body itself.
+       */
+      void write(std::vector<asio::const_buffer>& buffers, bool with_body = true);
+
+    private:
+      char status_line_[24];
+      char content_length_[48];
     };
 
 
     class http_delegate {
     public:
+      virtual ~http_delegate() = default;
+
+      /**
+       * Called once the request line and the headers are in, before any of the body. This is where a delegate can
+       * decide to stream the body using HttpRequest::stream_body(), otherwise the body gets buffered in the request.
+       */
+      virtual void headers_received(HttpRequest&) {}
+
       virtual std::unique_ptr<HttpResponse> handle(HttpRequest& request) = 0;
     };
 
 
+    /**
+     * Whether a handler given to a server is a delegate of its own, e.g. a routing_delegate, rather than a function.
+     */
+    template<typename Handler>
+    constexpr bool is_delegate = std::is_convertible_v<Handler, std::shared_ptr<http_delegate>>;
+
+
     template<typename Handler>
     class func_delegate : public http_delegate {
     public:
@@ -83,17 +253,71 @@ namespace suspiria {
     };
 
 
+    /**
+     * Routes every request to the delegate its host and path resolve to, see HostRouter. Routes are resolved as soon
+     * as the headers are in, so the delegates they lead to get their headers_received() call too, and the parameters
+     * of the route are in HttpRequest::params by then. Requests that resolve to nothing get a 404, or a 405 listing
+     * the allowed methods if their path has handlers for other methods; OPTIONS requests for such a path get a 200
+     * listing them. Pass it to http_server as its delegate.
+     *
+     * The router is shared by every connection: it and the routers behind it must not change while serving, a
+     * RouterHolder behind a host is the way to change the routes of that host. Requests keep the table they were
+     * resolved on (see Router::snapshot()) until they are handled, whatever gets published in the meantime.
+     */
+    class routing_delegate : public http_delegate {
+    public:
+      explicit routing_delegate(std::shared_ptr<const HostRouter<http_delegate>> hosts) : hosts_(std::move(hosts)) {}
+
+      void headers_received(HttpRequest& request) override;
+      std::unique_ptr<HttpResponse> handle(HttpRequest& request) override;
+
+    private:
+      void route(HttpRequest& request) const;
+
+      std::shared_ptr<const HostRouter<http_delegate>> hosts_;
+    };
+
+
+    /**
+     * How long a connection may keep the server waiting before it gets closed. Zero turns a timeout off.
+     */
+    struct http_timeouts {
+      typedef timer_wheel::clock::duration duration;
+
+      duration keep_alive = std::chrono::seconds(60);  // idle time allowed between requests.
+      duration request_header = std::chrono::seconds(30);  // time allowed to send a request line and its headers.
+      duration body = std::chrono::seconds(30);  // idle time allowed between two pieces of a request body.
+      duration write = std::chrono::seconds(60);  // time allowed for the peer to take each batch of responses.
+    };
+
+
+    /**
+     * How much of a request the server holds in memory. Requests over a limit get turned down.
+     */
+    struct http_limits {
+      size_t max_buffered_body = 8 * 1024 * 1024;  // bodies that aren't streamed, longer ones get 413.
+    };
+
+
     class http_protocol_factory : public protocol_factory {
     public:
       http_protocol_factory(std::shared_ptr<http_delegate> delegate) : delegate_(std::move(delegate)) {}
 
-      template<typename Handler>
+      template<typename Handler, typename = std::enable_if_t<!is_delegate<Handler>>>
       http_protocol_factory(Handler handler) : delegate_(std::make_shared<func_delegate<Handler>>(std::move(handler))) {}
 
+      const http_timeouts& get_timeouts() const noexcept { return timeouts_; }
+      void set_timeouts(const http_timeouts& timeouts) { timeouts_ = timeouts; }
+
+      const http_limits& get_limits() const noexcept { return limits_; }
+      void set_limits(const http_limits& limits) { limits_ = limits; }
+
       std::unique_ptr<protocol> create_protocol(tcp_connection& connection) override;
 
     protected:
       std::shared_ptr<http_delegate> delegate_;
+      http_timeouts timeouts_;
+      http_limits limits_;
     };
 
 
@@ -102,12 +326,31 @@ namespace suspiria {
       http_server(const http_server& another) = delete;
       explicit http_server(
         asio::io_context& io, std::string host, unsigned short port, std::shared_ptr<http_delegate> delegate
-      ) : tcp_server(io, std::move(host), port, std::make_shared<http_protocol_factory>(std::move(delegate))) {}
+      ) : http_server(io, std::move(host), port, std::make_shared<http_protocol_factory>(std::move(delegate))) {}
 
-      template<typename Handler>
+      template<typename Handler, typename = std::enable_if_t<!is_delegate<Handler>>>
       explicit http_server(
         asio::io_context& io, std::string host, unsigned short port, Handler handler
-      ) : tcp_server(io, std::move(host), port, std::make_shared<http_protocol_factory>(handler)) {}
+      ) : http_server(io, std::move(host), port, std::make_shared<http_protocol_factory>(handler)) {}
+
+      /**
+       * Sets the keep-alive, request header, body and write timeouts of the connections. Has to be called before
+       * start().
+       */
+      void set_timeouts(const http_timeouts& timeouts) { factory_->set_timeouts(timeouts); }
+
+      /**
+       * Sets how much of a request the connections buffer, see HttpRequest::stream_body() for larger bodies. Has to
+       * be called before start().
+       */
+      void set_limits(const http_limits& limits) { factory_->set_limits(limits); }
+
+    private:
+      http_server(
+        asio::io_context& io, std::string host, unsigned short port, std::shared_ptr<http_protocol_factory> factory
+      ) : tcp_server(io, std::move(host), port, factory), factory_(std::move(factory)) {}
+
+      std::shared_ptr<http_protocol_factory> factory_;
     };
 
   }
@@ -0,0 +1,121 @@
+//
+// Created by Peyman Mortazavi on 2019-05-24.
+//
+
+#ifndef SUSPIRIA_HTTP_METHOD_H
+#define SUSPIRIA_HTTP_METHOD_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace suspiria {
+
+  namespace networking {
+
+    /**
+     * Request methods, numbered the way http_parser reports them.
+     */
+    enum HttpMethod : unsigned int {
+      DELETE = 0,
+      GET = 1,
+      HEAD = 2,
+      POST = 3,
+      PUT = 4,
+      CONNECT = 5,
+      OPTIONS = 6,
+      TRACE = 7,
+      PATCH = 28,
+    };
+
+    /**
+     * Number of methods routes can be registered for, see method_index().
+     */
+    constexpr size_t http_method_count = 9;
+
+    /**
+     * @return A dense index for the method in [0, http_method_count) or -1 for methods routes can't be registered for.
+     */
+    constexpr int method_index(HttpMethod method) noexcept {
+      if (method <= TRACE) return static_cast<int>(method);
+      return method == PATCH ? 8 : -1;
+    }
+
+    constexpr HttpMethod method_at(size_t index) noexcept {
+      return index == 8 ? PATCH : static_cast<HttpMethod>(index);
+    }
+
+    constexpr std::string_view to_string(HttpMethod method) noexcept {
+      constexpr std::string_view names[http_method_count] = {
+        "DELETE", "GET", "HEAD", "POST", "PUT", "CONNECT", "OPTIONS", "TRACE", "PATCH"
+      };
+      auto index = method_index(method);
+      return index < 0 ? std::string_view{} : names[index];
+    }
+
+    /**
+     * @return The method to_string() gives the name of, nothing for any other name.
+     */
+    constexpr std::optional<HttpMethod> method_from_string(std::string_view name) noexcept {
+      for (size_t index = 0; index < http_method_count; index++) {
+        if (to_string(method_at(index)) == name) return method_at(index);
+      }
+      return std::nullopt;
+    }
+
+    /**
+     * A set of methods packed in a bit mask, e.g. the methods a route has handlers for.
+     */
+    class HttpMethods {
+    public:
+      constexpr HttpMethods() noexcept = default;
+
+      static constexpr HttpMethods all() noexcept { return HttpMethods{(1u << http_method_count) - 1}; }
+      static constexpr HttpMethods from_mask(uint16_t mask) noexcept { return HttpMethods{mask}; }
+
+      constexpr bool contains(HttpMethod method) const noexcept {
+        auto index = method_index(method);
+        return index >= 0 && (mask_ & (1u << index));
+      }
+
+      constexpr void add(HttpMethod method) noexcept {
+        auto index = method_index(method);
+        if (index >= 0) mask_ |= 1u << index;
+      }
+
+      constexpr void remove(HttpMethod method) noexcept {
+        auto index = method_index(method);
+        if (index >= 0) mask_ &= ~(1u << index);
+      }
+
+      constexpr bool empty() const noexcept { return mask_ == 0; }
+      constexpr uint16_t mask() const noexcept { return mask_; }
+
+      constexpr bool operator==(const HttpMethods& other) const noexcept { return mask_ == other.mask_; }
+      constexpr bool operator!=(const HttpMethods& other) const noexcept { return mask_ != other.mask_; }
+
+      /**
+       * The methods separated by commas, ready for an Allow header, e.g. "GET, HEAD, OPTIONS".
+       */
+      std::string to_string() const {
+        std::string result;
+        for (size_t index = 0; index < http_method_count; index++) {
+          if (!(mask_ & (1u << index))) continue;
+          if (!result.empty()) result += ", ";
+          result += networking::to_string(method_at(index));
+        }
+        return result;
+      }
+
+    private:
+      constexpr explicit HttpMethods(uint16_t mask) noexcept : mask_(mask) {}
+
+      uint16_t mask_ = 0;
+    };
+
+  }
+
+}
+
+#endif //SUSPIRIA_HTTP_METHOD_H
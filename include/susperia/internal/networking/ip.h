@@ -5,57 +5,169 @@
 #ifndef SUSPIRIA_IP_H
 #define SUSPIRIA_IP_H
 
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_set>
+#include <thread>
+#include <vector>
 
 #include <asio.hpp>
 
+#include "susperia/internal/utility.h"
+#include "buffer_pool.h"
+#include "handler_memory.h"
 #include "protocol.h"
+#include "slab.h"
+#include "timer_wheel.h"
 
 
 namespace suspiria::networking {
 
+  template<typename ConnectionType> class pool;
+
+  /**
+   * The links a connection needs to be kept in a pool. Connections inherit it, so adding and removing them is a matter
+   * of updating a few pointers and the pool never allocates anything of its own.
+   */
+  template<typename ConnectionType>
+  class pool_hook {
+  private:
+    template<typename> friend class pool;
+    ConnectionType* pool_previous_ = nullptr;
+    ConnectionType* pool_next_ = nullptr;
+    std::shared_ptr<ConnectionType> pool_reference_;  // keeps the connection alive while it is in the pool.
+  };
+
+
+  /**
+   * Keeps the connections alive while they are open. Connections may come and go from any of the server threads,
+   * unless the pool is owned by a single thread in which case it can skip locking altogether. Connections are created
+   * by the pool itself out of a slab and linked into an intrusive list, so both opening and closing a connection are
+   * O(1) and, once the slab has grown to the peak number of connections, allocation free.
+   */
   template <typename ConnectionType>
   class pool {
   public:
-    explicit pool() = default;
+    static constexpr size_t unlimited = std::numeric_limits<size_t>::max();
+
+    /**
+     * @param max_connections Number of open connections after which create_connection() turns new ones down.
+     * @param thread_safe Whether connections are created and closed from more than one thread.
+     */
+    explicit pool(size_t max_connections=unlimited, bool thread_safe=true)
+      : max_connections_(max_connections), mutex_(thread_safe),
+        slab_(std::make_shared<slab>(slab::default_blocks_per_chunk, thread_safe)) {}
     pool(const pool&) = delete;
     ~pool() {
       this->close_all();
     }
 
-    void add_connection(std::shared_ptr<ConnectionType> connection) {
-      connections_.emplace(std::move(connection));
+    size_t size() const {
+      std::lock_guard<utility::optional_mutex> lock{mutex_};
+      return size_;
+    }
+    size_t max_connections() const noexcept { return max_connections_; }
+
+    /**
+     * Creates a connection and adds it to the pool.
+     * @return The new connection, or nullptr if the pool already holds max_connections() connections.
+     */
+    template<typename... Args>
+    std::shared_ptr<ConnectionType> create_connection(Args&&... args) {
+      std::lock_guard<utility::optional_mutex> lock{mutex_};
+      if (size_ >= max_connections_) return nullptr;
+      auto connection = std::allocate_shared<ConnectionType>(
+        slab_allocator<ConnectionType>(slab_), std::forward<Args>(args)...
+      );
+      hook_type& hook = *connection;
+      hook.pool_reference_ = connection;
+      hook.pool_next_ = head_;
+      if (head_) static_cast<hook_type&>(*head_).pool_previous_ = connection.get();
+      head_ = connection.get();
+      size_++;
+      return connection;
     }
 
-    void close_connection(std::shared_ptr<ConnectionType> connection) {
-      auto it = connections_.find(connection);
-      if (it != end(connections_)) {
-        connections_.erase(it);
+    /**
+     * Removes the connection from the pool, it is destroyed as soon as nothing else refers to it. Connections that
+     * are not in the pool (anymore) are ignored.
+     */
+    void close_connection(ConnectionType& connection) {
+      std::shared_ptr<ConnectionType> reference;  // released after unlocking, it may well be the last one.
+      {
+        std::lock_guard<utility::optional_mutex> lock{mutex_};
+        hook_type& hook = connection;
+        if (!hook.pool_reference_) return;
+        if (hook.pool_previous_) {
+          static_cast<hook_type&>(*hook.pool_previous_).pool_next_ = hook.pool_next_;
+        } else {
+          head_ = hook.pool_next_;
+        }
+        if (hook.pool_next_) static_cast<hook_type&>(*hook.pool_next_).pool_previous_ = hook.pool_previous_;
+        hook.pool_previous_ = hook.pool_next_ = nullptr;
+        reference = std::move(hook.pool_reference_);
+        size_--;
       }
     }
 
-    void close_all() {
-      connections_.clear();
+    /**
+     * Drops all the connections at once. Every connection is unlinked under the lock, so one closing itself on another
+     * thread in the meantime finds itself out of the pool already, and the references are released outside of it.
+     * @return The connections that were in the pool, they are gone once the caller and everything else let go of them.
+     */
+    std::vector<std::shared_ptr<ConnectionType>> close_all() {
+      std::vector<std::shared_ptr<ConnectionType>> references;
+      std::lock_guard<utility::optional_mutex> lock{mutex_};
+      references.reserve(size_);
+      for (auto head = head_; head;) {
+        hook_type& hook = *head;
+        head = hook.pool_next_;
+        hook.pool_previous_ = hook.pool_next_ = nullptr;
+        references.push_back(std::move(hook.pool_reference_));
+      }
+      head_ = nullptr;
+      size_ = 0;
+      return references;
     }
 
   private:
-    std::unordered_set<std::shared_ptr<ConnectionType>> connections_;
+    typedef pool_hook<ConnectionType> hook_type;
+
+    size_t max_connections_;
+    size_t size_ = 0;
+    ConnectionType* head_ = nullptr;
+    mutable utility::optional_mutex mutex_;
+    std::shared_ptr<slab> slab_;
   };
 
 
-  class tcp_connection : public std::enable_shared_from_this<tcp_connection> {
+  /**
+   * A single TCP connection. All of its handlers run on the strand of its socket's executor so a connection is never
+   * touched by two threads at once, even when the io_context runs on many threads. pause_reading(), resume_reading()
+   * and the write functions are meant to be called from within those handlers (e.g. from the protocol).
+   *
+   * The pools and the timer wheel of the listener are shared with its connections, pending handlers keep connections
+   * alive and those may well outlive the listener that accepted them.
+   */
+  class tcp_connection : public std::enable_shared_from_this<tcp_connection>, public pool_hook<tcp_connection> {
   public:
     tcp_connection(const tcp_connection&) = delete;
-    explicit tcp_connection(asio::ip::tcp::socket&& socket, pool<tcp_connection>& pool) : socket_(std::move(socket)), pool_(pool) {
-      receive_buffer_ = new char[4];
+    explicit tcp_connection(
+      asio::ip::tcp::socket&& socket, std::shared_ptr<pool<tcp_connection>> pool,
+      std::shared_ptr<buffer_pool> buffers, std::shared_ptr<timer_wheel> timers
+    ) : socket_(std::move(socket)), pool_(std::move(pool)), buffers_(std::move(buffers)), timers_(std::move(timers)),
+        read_size_(buffers_->slab_size()), read_deadline_(*this), write_deadline_(*this) {
+      asio::error_code ec;
+      socket_.non_blocking(true, ec);  // reads happen only once the socket is known to be readable.
     }
     ~tcp_connection() {
-      delete[] this->receive_buffer_;
+      timers_->cancel(read_deadline_);
+      timers_->cancel(write_deadline_);
     }
 
     asio::ip::tcp::socket& get_socket() { return socket_; }
+    buffer_pool& get_buffer_pool() { return *buffers_; }
 
     void set_protocol(std::unique_ptr<protocol>&& protocol) {
       protocol_ = std::move(protocol);
@@ -69,88 +181,416 @@ namespace suspiria::networking {
       if (!is_reading_) run_receive_loop();
     }
 
+    /**
+     * Closes the connection unless the read timeout is set again or cleared within the given time. What counts as
+     * reading too slowly (e.g. waiting too long for the next request) is up to the protocol.
+     */
+    void set_read_timeout(timer_wheel::clock::duration timeout) {
+      if (timeout == timeout.zero()) {
+        this->clear_read_timeout();
+      } else {
+        timers_->schedule(read_deadline_, timeout);
+      }
+    }
+
+    void clear_read_timeout() { timers_->cancel(read_deadline_); }
+
+    /**
+     * Closes the connection if a write takes longer than the given time to go out, e.g. because the peer stopped
+     * reading. Zero, the default, lets writes take forever.
+     */
+    void set_write_timeout(timer_wheel::clock::duration timeout) { write_timeout_ = timeout; }
+
+    /**
+     * Queues buffers to be sent to the peer. Nothing gets copied: buffers queued while a write is in progress are
+     * gathered and sent together with a single async_write once it finishes, which also takes care of short writes.
+     * The memory behind the buffers has to stay valid until protocol::data_written() reports the write as sent.
+     */
+    void write(const std::vector<asio::const_buffer>& buffers) {
+      if (is_closed_) return;
+      pending_buffers_.insert(end(pending_buffers_), begin(buffers), end(buffers));
+      pending_writes_++;
+      if (!is_writing_) run_write_loop();
+    }
+
+    void write(asio::const_buffer buffer) {
+      this->write(std::vector<asio::const_buffer>{buffer});
+    }
+
+    /**
+     * Closes the connection as soon as everything queued so far is sent.
+     */
+    void close_after_writing() {
+      if (is_writing_) {
+        close_after_writing_ = true;
+      } else {
+        this->close();
+      }
+    }
+
+    /**
+     * Closes the connection. It is safe to call from any thread, the actual work always happens on the connection's
+     * strand (right away if the caller is already on it).
+     */
     void close() {
-      asio::error_code ec;
-      socket_.shutdown(socket_.shutdown_both, ec);
-      protocol_->connection_lost();
-      pool_.close_connection(shared_from_this());
+      auto self(shared_from_this());
+      asio::dispatch(socket_.get_executor(), [this, self] {
+        if (is_closed_) return;
+        is_closed_ = true;
+        timers_->cancel(read_deadline_);
+        timers_->cancel(write_deadline_);
+        asio::error_code ec;
+        socket_.shutdown(socket_.shutdown_both, ec);
+        if (protocol_) protocol_->connection_lost();  // a closing listener may get to it before its protocol is set.
+        pool_->close_connection(*this);
+      });
     }
 
   private:
-    void run_receive_loop() {
-      this->is_reading_ = true;
+    /**
+     * Closes the connection once it expires. The wheel fires it from its own thread with the wheel locked, so closing
+     * is posted to the connection's strand. Only a weak reference goes along: dropping the last strong one here would
+     * destroy the connection, which cancels its timers and needs the wheel's lock.
+     */
+    class deadline : public timer_wheel::timer {
+    public:
+      explicit deadline(tcp_connection& connection) : connection_(connection) {}
+
+    protected:
+      void expired() override {
+        asio::post(connection_.socket_.get_executor(), [weak_connection = connection_.weak_from_this()] {
+          if (auto connection = weak_connection.lock()) connection->close();
+        });
+      }
+
+    private:
+      tcp_connection& connection_;
+    };
+
+    /**
+     * Non owning view of the buffers being sent, async_write keeps a copy of the sequence it's given and copying the
+     * vector would cost an allocation per write. sending_buffers_ is left alone until the write completes.
+     */
+    struct buffer_span {
+      const asio::const_buffer* first;
+      const asio::const_buffer* last;
+      const asio::const_buffer* begin() const noexcept { return first; }
+      const asio::const_buffer* end() const noexcept { return last; }
+    };
+
+    void run_write_loop() {
+      this->is_writing_ = true;
+      std::swap(pending_buffers_, sending_buffers_);
+      sending_writes_ = pending_writes_;
+      pending_writes_ = 0;
+      if (write_timeout_ != write_timeout_.zero()) timers_->schedule(write_deadline_, write_timeout_);
       auto self(shared_from_this());
-      socket_.async_receive(asio::buffer(receive_buffer_, 4), [this, self](const auto& error_code, size_t length) {
+      buffer_span buffers{sending_buffers_.data(), sending_buffers_.data() + sending_buffers_.size()};
+      asio::async_write(socket_, buffers, bind_memory(write_memory_, [this, self](const auto& error_code, size_t) {
+        this->is_writing_ = false;
         if (error_code) {
           if (error_code != asio::error::operation_aborted) this->close();
           return;
         }
-        protocol_->data_received(receive_buffer_, length);
-        if (!socket_.is_open()) {
+        sending_buffers_.clear();  // keeps the capacity around for the next write.
+        protocol_->data_written(sending_writes_);
+        if (this->is_writing_) return;  // the protocol has already started the next write.
+        if (!pending_buffers_.empty()) {
+          this->run_write_loop();
+        } else if (close_after_writing_) {
           this->close();
-        } else if (!this->reading_paused_) {
-          this->run_receive_loop();
-        } else {
-          this->is_reading_ = false;
+        } else if (write_timeout_ != write_timeout_.zero()) {
+          timers_->cancel(write_deadline_);
         }
-      });
+      }));
+    }
+
+    /**
+     * Waits for the socket to become readable without holding any buffer, this way idle connections cost no memory.
+     */
+    void run_receive_loop() {
+      this->is_reading_ = true;
+      auto self(shared_from_this());
+      socket_.async_wait(asio::ip::tcp::socket::wait_read, bind_memory(read_memory_, [this, self](const auto& error_code) {
+        if (error_code) {
+          if (error_code != asio::error::operation_aborted) this->close();
+          return;
+        }
+        this->receive_available();
+      }));
+    }
+
+    /**
+     * Borrows a slab from the buffer pool and keeps reading as long as the reads fill up the requested size, which
+     * means there is likely more data waiting in the socket. The slab goes back to the pool right after.
+     */
+    void receive_available() {
+      auto buffer = buffers_->acquire();
+      asio::error_code error_code;
+      size_t requested, length;
+      do {
+        requested = read_size_.size();
+        length = socket_.read_some(asio::buffer(buffer.get(), requested), error_code);
+        if (error_code) break;
+        read_size_.update(length);
+        protocol_->data_received(buffer.get(), length);
+      } while (length == requested && !is_closed_ && !reading_paused_);
+      buffers_->release(std::move(buffer));
+
+      if (error_code && error_code != asio::error::would_block) {
+        this->close();
+      } else if (is_closed_ || reading_paused_) {
+        this->is_reading_ = false;
+      } else {
+        this->run_receive_loop();
+      }
     }
 
     bool is_reading_ = false;
     bool reading_paused_ = false;
-    std::unique_ptr<protocol> protocol_;
-    char* receive_buffer_;
-    asio::streambuf send_buffer_;
+    bool is_closed_ = false;
+    bool is_writing_ = false;
+    bool close_after_writing_ = false;
+    size_t pending_writes_ = 0;
+    size_t sending_writes_ = 0;
+    std::vector<asio::const_buffer> pending_buffers_;
+    std::vector<asio::const_buffer> sending_buffers_;
+    handler_memory read_memory_;
+    handler_memory write_memory_;
     asio::ip::tcp::socket socket_;
-    pool<tcp_connection>& pool_;
+    std::shared_ptr<pool<tcp_connection>> pool_;
+    std::shared_ptr<buffer_pool> buffers_;
+    std::shared_ptr<timer_wheel> timers_;
+    read_size_hint read_size_;
+    timer_wheel::clock::duration write_timeout_ = timer_wheel::clock::duration::zero();
+    deadline read_deadline_;
+    deadline write_deadline_;
+    std::unique_ptr<protocol> protocol_;  // goes first, it may still give memory back to the buffer pool.
   };
 
 
-  class tcp_server {
+#ifdef SO_REUSEPORT
+  typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
+
+  /**
+   * Accepts connections on a single acceptor and keeps them in its own connection and buffer pools. A tcp_server is
+   * made of a single listener, or of one listener per worker in the sharded mode.
+   */
+  class tcp_listener {
   public:
-    tcp_server(tcp_server& server) = delete;
-    explicit tcp_server(
-      asio::io_context& io,
-      std::string host,
-      unsigned short port,
-      std::shared_ptr<protocol_factory> factory
-    ) : io_(io), host_(std::move(host)), port_(port), acceptor_(io), protocol_factory_(std::move(factory)) {}
+    tcp_listener(const tcp_listener&) = delete;
 
-    void start() {
-      asio::ip::tcp::resolver resolver{io_};
-      asio::ip::tcp::endpoint endpoint = *resolver.resolve(host_, std::to_string(port_)).begin();
+    /**
+     * @param io The io_context the acceptor and all the accepted connections run on.
+     * @param factory Creates the protocol of each accepted connection.
+     * @param max_connections Number of open connections after which newly accepted ones are closed right away.
+     */
+    explicit tcp_listener(
+      asio::io_context& io, protocol_factory& factory, size_t max_connections=pool<tcp_connection>::unlimited
+    ) : io_(io), executor_(io.get_executor()), acceptor_(io), protocol_factory_(factory),
+        max_connections_(max_connections) {}
+    ~tcp_listener() {
+      this->close();
+    }
+
+    /**
+     * The executor the acceptor's handlers run on, close() the listener there when io is running.
+     */
+    const asio::executor& get_executor() const noexcept { return executor_; }
+
+    /**
+     * Binds the acceptor and starts listening, connections queue up in the backlog until accept() is called.
+     */
+    void listen(const asio::ip::tcp::endpoint& endpoint, bool share_port=false) {
       this->acceptor_.open(endpoint.protocol());
       this->acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+      if (share_port) {
+#ifdef SO_REUSEPORT
+        this->acceptor_.set_option(reuse_port(true));
+#else
+        throw asio::system_error(asio::error::operation_not_supported, "SO_REUSEPORT");
+#endif
+      }
       this->acceptor_.bind(endpoint);
       this->acceptor_.listen();
+    }
+
+    /**
+     * Starts accepting connections, once.
+     * @param concurrent Whether io runs on more than one thread. Concurrent listeners bind each connection to a strand
+     * and lock their pools, the others skip all of that.
+     */
+    void accept(bool concurrent) {
+      if (pool_) return;
+      concurrent_ = concurrent;
+      if (concurrent) executor_ = asio::make_strand(io_);
+      buffers_ = std::make_shared<buffer_pool>(
+        buffer_pool::default_slab_size, buffer_pool::default_max_idle_slabs, concurrent
+      );
+      timers_ = std::make_shared<timer_wheel>(io_, concurrent);
+      pool_ = std::make_shared<pool<tcp_connection>>(max_connections_, concurrent);
+      this->timers_->start();
       this->run_accept_loop();
     }
 
-    void stop() {
-      this->acceptor_.close();
-      this->pool_.close_all();
+    bool is_accepting() const noexcept { return pool_ != nullptr; }
+
+    /**
+     * Stops accepting and closes every open connection. Connections are closed on their own strands, so some of them
+     * may still be closing once this returns.
+     */
+    void close() {
+      asio::error_code ec;
+      this->acceptor_.close(ec);
+      if (!pool_) return;
+      this->timers_->stop();
+      for (auto& connection : this->pool_->close_all()) connection->close();
     }
 
+    asio::ip::tcp::endpoint local_endpoint() const { return acceptor_.local_endpoint(); }
+
   private:
     void run_accept_loop() {
-      this->acceptor_.async_accept([this](const auto& error_code, auto socket) {
+      // Every accepted socket of a concurrent listener gets its own strand which all of its handlers will run on.
+      auto executor = concurrent_ ? asio::executor(asio::make_strand(io_)) : asio::executor(io_.get_executor());
+      auto on_accept = [this](const auto& error_code, auto socket) {
         if (!socket.is_open()) return;  // If the socket isn't open for any reason, do not proceed.
         if (error_code) {  // if there is any error, print it out for now and move on.
-        } else {  // create a connection and add it to the connection pool.
-          auto connection = std::make_shared<tcp_connection>(std::move(socket), pool_);
-          connection->set_protocol(protocol_factory_->create_protocol(*connection));
-          pool_.add_connection(move(connection));
+        } else if (auto connection = pool_->create_connection(std::move(socket), pool_, buffers_, timers_)) {
+          // the connection is in the pool before it gets the chance to close itself.
+          connection->set_protocol(protocol_factory_.create_protocol(*connection));
+        } else {  // the pool is full, turn the peer down. The socket was left untouched since nothing got constructed.
+          asio::error_code ec;
+          socket.close(ec);
         }
         run_accept_loop();
-      });
+      };
+      this->acceptor_.async_accept(executor, asio::bind_executor(executor_, std::move(on_accept)));
+    }
+
+    asio::io_context& io_;
+    asio::executor executor_;  // a strand for concurrent listeners, so closing never races the accept loop.
+    asio::ip::tcp::acceptor acceptor_;
+    protocol_factory& protocol_factory_;
+    size_t max_connections_;
+    bool concurrent_ = false;
+    std::shared_ptr<buffer_pool> buffers_;
+    std::shared_ptr<timer_wheel> timers_;
+    std::shared_ptr<pool<tcp_connection>> pool_;
+  };
+
+
+  class tcp_server {
+  public:
+    tcp_server(tcp_server& server) = delete;
+    explicit tcp_server(
+      asio::io_context& io,
+      std::string host,
+      unsigned short port,
+      std::shared_ptr<protocol_factory> factory
+    ) : protocol_factory_(std::move(factory)), port_(port), host_(std::move(host)), io_(io) {}
+
+    /**
+     * Limits the number of connections kept open at once, connections accepted beyond that are closed right away.
+     * In the shared nothing mode every worker gets an equal share of the limit. Has to be called before start().
+     */
+    void set_max_connections(size_t max_connections) { max_connections_ = max_connections; }
+
+    /**
+     * Sets the number of threads run() serves the io_context with, hardware_concurrency() is a good choice. With more
+     * than one, every connection is bound to a strand and the pools are locked, a single thread skips all of that.
+     * Servers whose io_context is run elsewhere give the number of threads running it. Has to be called before
+     * start(), the shared nothing mode ignores it.
+     */
+    void set_threads(size_t threads) { threads_ = threads; }
+
+    /**
+     * Starts accepting connections on a single acceptor that runs on the io_context given to the server.
+     */
+    void start() {
+      auto& listener = listeners_.emplace_back(
+        std::make_shared<tcp_listener>(io_, *protocol_factory_, max_connections_)
+      );
+      listener->listen(this->resolve_endpoint());
+      listener->accept(threads_ > 1);
+    }
+
+    /**
+     * Starts the server in the shared nothing mode. Every worker gets its own io_context, acceptor and connection
+     * pool, and all acceptors listen on the same port using SO_REUSEPORT so the kernel balances the connections
+     * between them. Connections never leave the worker that accepted them, so nothing on the hot path is locked.
+     * Call run() afterwards to run each worker on its own thread.
+     * @param workers Number of workers, usually one per core.
+     */
+    void start(size_t workers) {
+      auto endpoint = this->resolve_endpoint();
+      auto max_connections = max_connections_ == pool<tcp_connection>::unlimited
+        ? max_connections_ : (max_connections_ + workers - 1) / workers;
+      for (size_t index = 0; index < workers; index++) {
+        auto& io = worker_contexts_.emplace_back(std::make_unique<asio::io_context>(1));
+        auto& listener = listeners_.emplace_back(
+          std::make_shared<tcp_listener>(*io, *protocol_factory_, max_connections)
+        );
+        listener->listen(endpoint, true);
+        listener->accept(false);
+        endpoint = listener->local_endpoint();  // the port the first one got, for servers started on port zero.
+      }
+    }
+
+    /**
+     * The endpoint the server listens on, e.g. to find out which port it got when started on port zero.
+     */
+    asio::ip::tcp::endpoint local_endpoint() const { return listeners_.front()->local_endpoint(); }
+
+    /**
+     * Stops accepting and closes the open connections. Every listener is closed on its own executor, so it is safe to
+     * call from any thread.
+     */
+    void stop() {
+      for (auto& listener : listeners_) {
+        asio::dispatch(listener->get_executor(), [listener] { listener->close(); });
+      }
+    }
+
+    /**
+     * Runs the server and blocks until it runs out of work. The calling thread is one of the threads doing the work.
+     * In the shared nothing mode, every worker runs on its own thread. Otherwise, the io_context runs on the number
+     * of threads given to set_threads(). With more than one of them, each connection is bound to its own strand, so
+     * the protocol factory and whatever it shares between protocols (e.g. the http delegate) are the only pieces that
+     * need to be thread safe.
+     */
+    void run() {
+      std::vector<std::thread> workers;
+      if (worker_contexts_.empty()) {
+        for (size_t index = 1; index < threads_; index++) {
+          workers.emplace_back([this] { io_.run(); });
+        }
+        io_.run();
+      } else {
+        for (size_t index = 1; index < worker_contexts_.size(); index++) {
+          workers.emplace_back([&io = *worker_contexts_[index]] { io.run(); });
+        }
+        worker_contexts_.front()->run();
+      }
+      for (auto& worker : workers) worker.join();
+    }
+
+  private:
+    asio::ip::tcp::endpoint resolve_endpoint() {
+      asio::ip::tcp::resolver resolver{io_};
+      return *resolver.resolve(host_, std::to_string(port_)).begin();
     }
 
     std::shared_ptr<protocol_factory> protocol_factory_;
+    size_t max_connections_ = pool<tcp_connection>::unlimited;
+    size_t threads_ = 1;
     unsigned short port_;
     std::string host_;
-    asio::ip::tcp::acceptor acceptor_;
     asio::io_context& io_;
-    pool<tcp_connection> pool_;
+    std::vector<std::unique_ptr<asio::io_context>> worker_contexts_;
+    std::vector<std::shared_ptr<tcp_listener>> listeners_;  // shared with the closes stop() queued.
   };
 
 }
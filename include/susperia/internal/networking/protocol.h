@@ -18,6 +18,7 @@ namespace suspiria::networking {
     virtual void connection_made() = 0;
     virtual void data_received(const char* bytes, size_t length) = 0;
     virtual void connection_lost() = 0;
+    virtual void data_written(size_t /*writes*/) {}  // called once that many of the oldest queued writes are sent.
     virtual ~protocol() {};
 
   protected:
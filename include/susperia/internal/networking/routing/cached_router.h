@@ -0,0 +1,245 @@
+//
+// Created by Peyman Mortazavi on 2019-05-26.
+//
+
+#ifndef SUSPIRIA_CACHED_ROUTER_H
+#define SUSPIRIA_CACHED_ROUTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "router.h"
+
+namespace suspiria {
+
+  namespace networking {
+
+    /**
+     * A bounded cache of resolved paths in front of another router, for traffic that keeps asking for the same few
+     * paths. A hit costs a hash of the path and a copy out of one slot, no partitioning and no matching.
+     *
+     * The cache is a two way set associative table of slots, as many as the capacity rounded up to a power of two, each
+     * guarded by a seqlock: readers never lock or write anything shared, they copy the slot and retry nothing, a slot
+     * that was being written to is just a miss. Misses resolve the path on the router and try to fill a slot, giving up
+     * if another thread is filling it at the same time. Every slot remembers the version of the router it was filled at
+     * (see Router::version()), so adding routes invalidates the whole cache at once.
+     *
+     * Slots hold the handler as an index into a table of interned handlers, which keeps them trivially copyable. That
+     * table only grows: handlers stay alive as long as the cache does, and once max_handlers of them are interned,
+     * paths resolving to new ones are no longer cached. Paths longer than max_path_length or capturing more parameters
+     * than fit inline in RouteParams are never cached either.
+     *
+     * The router must outlive the cache. Results are the same as the router's, parameter names and values included.
+     */
+    template<class T>
+    class CachedRouter : public Router<T> {
+    public:
+      static constexpr size_t default_capacity = 1024;
+      static constexpr size_t max_handlers = 1024;
+      static constexpr size_t max_path_length = 128;
+
+      explicit CachedRouter(const Router<T>& router, size_t capacity=default_capacity)
+        : router_(router), slots_(round_up(capacity)), handlers_(new std::shared_ptr<T>[max_handlers]) {}
+      CachedRouter(const CachedRouter&) = delete;
+
+      ResolveResult<T> resolve(std::string_view path) const override {
+        return this->resolve(any_method, path, [this, path]() { return router_.resolve(path); });
+      }
+
+      ResolveResult<T> resolve(HttpMethod method, std::string_view path) const override {
+        return this->resolve(method, path, [this, method, path]() { return router_.resolve(method, path); });
+      }
+
+      uint64_t version() const noexcept override { return router_.version(); }
+
+      size_t capacity() const noexcept { return slots_.size(); }
+
+    private:
+      static constexpr uint32_t any_method = UINT32_MAX;
+
+      struct entry {
+        uint64_t version;
+        uint64_t hash;
+        uint32_t method;
+        uint32_t handler;  // one past the index of the interned handler, zero for paths that didn't match.
+        uint16_t allowed;
+        uint16_t path_length;
+        uint16_t param_count;
+      };
+
+      struct cached_param {
+        const char* name;
+        uint32_t name_length;
+        uint16_t value_offset;  // values are parts of the path, kept as offsets into it.
+        uint16_t value_length;
+        RouteParams::typed_value typed;
+      };
+      static_assert(std::is_trivially_copyable_v<cached_param>, "slots get copied word by word");
+
+      static constexpr size_t words_of(size_t bytes) { return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t); }
+
+      /**
+       * An entry spread over atomic words, so that reading it while it's being written is a stale read the sequence
+       * catches and not a data race. Lookups only read the words they need: the header, then as much of the path and
+       * of the parameters as there is.
+       */
+      struct slot {
+        std::atomic<uint64_t> sequence{0};  // odd while the slot is being written to, zero until the first write.
+        std::atomic<uint64_t> header[words_of(sizeof(entry))] = {};
+        std::atomic<uint64_t> path[words_of(max_path_length)] = {};
+        std::atomic<uint64_t> params[words_of(sizeof(cached_param) * RouteParams::inline_capacity)] = {};
+      };
+
+      static void read(const std::atomic<uint64_t>* words, void* target, size_t bytes) noexcept {
+        uint64_t buffer[words_of(max_path_length + sizeof(cached_param) * RouteParams::inline_capacity)];
+        for (size_t index = 0; index < words_of(bytes); index++) {
+          buffer[index] = words[index].load(std::memory_order_acquire);  // keeps the check of the sequence after them.
+        }
+        std::memcpy(target, buffer, bytes);
+      }
+
+      static void write(std::atomic<uint64_t>* words, const void* source, size_t bytes) noexcept {
+        uint64_t buffer[words_of(max_path_length + sizeof(cached_param) * RouteParams::inline_capacity)] = {};
+        std::memcpy(buffer, source, bytes);
+        for (size_t index = 0; index < words_of(bytes); index++) {
+          words[index].store(buffer[index], std::memory_order_release);  // keeps them after the odd sequence.
+        }
+      }
+
+      /**
+       * FNV-1a over the method and the path, eight bytes at a time.
+       */
+      static uint64_t hash(uint32_t method, std::string_view path) noexcept {
+        constexpr uint64_t prime = 1099511628211ull;
+        uint64_t value = (14695981039346656037ull ^ method) * prime;
+        for (; path.size() >= sizeof(uint64_t); path.remove_prefix(sizeof(uint64_t))) {
+          uint64_t word;
+          std::memcpy(&word, path.data(), sizeof(word));
+          value = (value ^ word) * prime;
+          value ^= value >> 32;
+        }
+        for (auto character : path) value = (value ^ static_cast<unsigned char>(character)) * prime;
+        return value ^ (value >> 29);
+      }
+
+      static size_t round_up(size_t capacity) {
+        if (capacity == 0) throw std::invalid_argument{"the cache needs at least one slot"};
+        size_t result = 1;
+        while (result < capacity) result <<= 1;
+        return result;
+      }
+
+      template<typename Resolve>
+      ResolveResult<T> resolve(uint32_t method, std::string_view path, Resolve&& resolve) const {
+        if (path.size() > max_path_length) return resolve();
+        auto path_hash = hash(method, path);
+        auto index = path_hash & (slots_.size() - 1);
+        auto& first = slots_[index];
+        auto& second = slots_[index ^ 1];  // same as first for a cache of a single slot.
+        auto version = router_.version();
+
+        ResolveResult<T> result;
+        if (this->load(first, version, path_hash, method, path, result)) return result;
+        if (this->load(second, version, path_hash, method, path, result)) return result;
+        result = resolve();
+        // a slot nobody uses any more if there's one, otherwise a bit of the hash picks which to evict: two paths that
+        // land on the same slots most likely pick different ones and both stay.
+        auto& target = this->is_stale(first, version) ? first :
+                       this->is_stale(second, version) ? second : (path_hash >> 63) ? second : first;
+        this->store(target, version, path_hash, method, path, result);
+        return result;
+      }
+
+      static bool is_stale(const slot& current, uint64_t version) noexcept {
+        return current.sequence.load(std::memory_order_relaxed) == 0 ||
+               current.header[0].load(std::memory_order_relaxed) != version;  // the version is the first field.
+      }
+
+      bool load(const slot& current, uint64_t version, uint64_t path_hash, uint32_t method, std::string_view path,
+                ResolveResult<T>& result) const {
+        auto sequence = current.sequence.load(std::memory_order_acquire);
+        if (sequence == 0 || (sequence & 1)) return false;
+        entry cached;
+        read(current.header, &cached, sizeof(cached));
+        if (cached.version != version || cached.hash != path_hash || cached.method != method ||
+            cached.path_length != path.size() || cached.param_count > RouteParams::inline_capacity) {
+          return false;  // the header might be torn, the sequence is only checked once the rest is read.
+        }
+        char cached_path[max_path_length];
+        read(current.path, cached_path, path.size());
+        cached_param params[RouteParams::inline_capacity];
+        read(current.params, params, sizeof(cached_param) * cached.param_count);
+        if (current.sequence.load(std::memory_order_relaxed) != sequence) return false;
+        if (std::memcmp(cached_path, path.data(), path.size()) != 0) return false;
+
+        result.allowed = HttpMethods::from_mask(cached.allowed);
+        if (cached.handler) {
+          result.matched = true;
+          result.handler = handlers_[cached.handler - 1];
+        }
+        for (size_t index = 0; index < cached.param_count; index++) {
+          auto& item = params[index];
+          auto value = path.substr(item.value_offset, item.value_length);
+          result.params.set({item.name, item.name_length}, value, item.typed);
+        }
+        return true;
+      }
+
+      void store(slot& current, uint64_t version, uint64_t path_hash, uint32_t method, std::string_view path,
+                 const ResolveResult<T>& result) const {
+        if (result.params.size() > RouteParams::inline_capacity) return;
+        entry cached{version, path_hash, method, 0, result.allowed.mask(), static_cast<uint16_t>(path.size()), 0};
+        cached_param params[RouteParams::inline_capacity];
+        auto path_begin = reinterpret_cast<uintptr_t>(path.data());
+        for (auto& item : result.params) {
+          auto value_begin = item.value.empty() ? path_begin : reinterpret_cast<uintptr_t>(item.value.data());
+          if (value_begin < path_begin || value_begin + item.value.size() > path_begin + path.size()) return;
+          params[cached.param_count++] = cached_param{
+            item.name.data(), static_cast<uint32_t>(item.name.size()), static_cast<uint16_t>(value_begin - path_begin),
+            static_cast<uint16_t>(item.value.size()), item.typed
+          };
+        }
+        if (result.matched && !(cached.handler = this->intern(result.handler))) return;
+
+        auto sequence = current.sequence.load(std::memory_order_relaxed);
+        if (sequence & 1) return;  // someone else is filling the slot.
+        if (!current.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_relaxed)) return;
+        write(current.header, &cached, sizeof(cached));
+        write(current.path, path.data(), path.size());
+        write(current.params, params, sizeof(cached_param) * cached.param_count);
+        current.sequence.store(sequence + 2, std::memory_order_release);
+      }
+
+      /**
+       * @return One past the index of the handler in the interned table, zero if the table is full.
+       */
+      uint32_t intern(const std::shared_ptr<T>& handler) const {
+        std::lock_guard<std::mutex> lock{handlers_mutex_};
+        auto it = handler_indices_.find(handler.get());
+        if (it != end(handler_indices_)) return it->second;
+        if (handler_indices_.size() == max_handlers) return 0;
+        auto index = static_cast<uint32_t>(handler_indices_.size());
+        handlers_[index] = handler;  // readers only see the index once the slot holding it gets published.
+        handler_indices_.emplace(handler.get(), index + 1);
+        return index + 1;
+      }
+
+      const Router<T>& router_;
+      mutable std::vector<slot> slots_;
+      std::unique_ptr<std::shared_ptr<T>[]> handlers_;
+      mutable std::unordered_map<const T*, uint32_t> handler_indices_;
+      mutable std::mutex handlers_mutex_;
+    };
+
+  }
+
+}
+
+#endif //SUSPIRIA_CACHED_ROUTER_H
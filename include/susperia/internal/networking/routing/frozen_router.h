@@ -0,0 +1,546 @@
+//
+// Created by Peyman Mortazavi on 2019-05-18.
+//
+
+#ifndef SUSPIRIA_FROZEN_ROUTER_H
+#define SUSPIRIA_FROZEN_ROUTER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "graph_router.h"
+#include "router.h"
+#include "susperia/internal/utility.h"
+
+namespace suspiria {
+
+  namespace networking {
+
+    /**
+     * An immutable copy of a GraphRouter laid out for fast lookups, see GraphRouter::freeze(). All nodes live in one
+     * array in breadth first order and refer to their children by index: the static children of a node are a range of
+     * edges sorted by the hash of their name that gets binary searched, and the dynamic children are a range of edges
+     * pointing at the matchers in the order they are tried in, along with the automaton that picks which of them to
+     * try. Names of the static children are packed into a single string. Resolving a path gives the exact same result
+     * as the graph it was frozen from, it only touches a few arrays doing so.
+     *
+     * Those arrays hold nothing but indices and characters and sit back to back in a single image, which is what makes
+     * snapshots cheap: save() writes the image to a file as is, along with the segments of the matchers and the names
+     * of the handlers, and load() maps the file back and uses the image in place. Handlers, matchers and automata are
+     * shared by every node that has the same ones, so all that gets rebuilt on load is one of each.
+     */
+    template<class T>
+    class FrozenRouter : public Router<T> {
+    public:
+      typedef std::function<std::string_view(const RouteMatcher&)> MatcherSpecs;
+      typedef std::function<std::string(const std::shared_ptr<T>&)> HandlerIds;
+
+      explicit FrozenRouter(const RouterNode<T>& root) {
+        std::vector<node> nodes(1);
+        std::vector<static_edge> static_edges;
+        std::vector<dynamic_edge> dynamic_edges;
+        std::vector<method_row> method_handlers;
+        std::string keys;
+        std::unordered_map<const RouterNode<T>*, uint32_t> indices{{&root, 0}};
+        std::vector<const RouterNode<T>*> queue{&root};
+        auto index_of = [&](const RouterNode<T>* node) {  // nodes reachable through many paths are only stored once.
+          auto it = indices.find(node);
+          if (it != end(indices)) return it->second;
+          auto index = static_cast<uint32_t>(queue.size());
+          indices.emplace(node, index);
+          queue.push_back(node);
+          nodes.emplace_back();
+          return index;
+        };
+        std::unordered_map<const T*, int32_t> handler_indices;
+        auto handler_of = [&](const std::shared_ptr<T>& handler) {
+          auto it = handler_indices.emplace(handler.get(), static_cast<int32_t>(handlers_.size()));
+          if (it.second) handlers_.push_back(handler);
+          return it.first->second;
+        };
+        std::unordered_map<const RouteMatcher*, uint32_t> matcher_indices;
+        std::map<std::vector<uint32_t>, int32_t> set_indices;  // nodes with the same matchers share an automaton.
+
+        for (size_t index = 0; index < queue.size(); index++) {
+          auto source = queue[index];
+          std::vector<std::pair<std::string_view, const RouterNode<T>*>> children;
+          for (auto& item : source->static_nodes) children.emplace_back(item.first, item.second.get());
+          std::stable_sort(begin(children), end(children), [](auto& first, auto& second) {
+            return hash(first.first) < hash(second.first);
+          });
+
+          node current;
+          current.static_begin = static_cast<uint32_t>(static_edges.size());
+          for (auto& child : children) {
+            auto name = child.first;
+            static_edges.push_back({
+              hash(name), static_cast<uint32_t>(keys.size()), static_cast<uint32_t>(name.size()), 0
+            });
+            keys += name;
+          }
+          current.static_end = static_cast<uint32_t>(static_edges.size());
+          current.dynamic_begin = static_cast<uint32_t>(dynamic_edges.size());
+          auto order = source->dynamic_order();  // an adaptive order is kept the way it was when frozen.
+          std::vector<uint32_t> edge_matchers;
+          for (auto child_index : order) {
+            auto& child = source->dynamic_nodes[child_index];
+            auto it = matcher_indices.emplace(child.matcher.get(), static_cast<uint32_t>(matchers_.size()));
+            if (it.second) matchers_.push_back(child.matcher);
+            edge_matchers.push_back(it.first->second);
+            dynamic_edges.push_back({it.first->second, 0, child.consumes_remainder});
+          }
+          current.dynamic_end = static_cast<uint32_t>(dynamic_edges.size());
+          if (auto set = source->get_dynamic_set()) {
+            auto it = set_indices.emplace(std::move(edge_matchers), static_cast<int32_t>(dynamic_sets_.size()));
+            if (it.second) {
+              dynamic_sets_.push_back(std::move(set));
+              set_edges_.push_back({current.dynamic_begin, current.dynamic_end});
+            }
+            current.dynamic_set = it.first->second;
+          }
+          if (source->handler) current.handler = handler_of(source->handler);
+          current.allowed = source->allowed_methods();
+          if (!source->methods().empty()) {
+            current.method_handlers = static_cast<int32_t>(method_handlers.size());
+            auto& table = method_handlers.emplace_back();
+            for (size_t offset = 0; offset < http_method_count; offset++) {
+              table[offset] = -1;
+              if (!source->methods().contains(method_at(offset))) continue;
+              table[offset] = handler_of(source->get_handler(method_at(offset)));
+            }
+          }
+          nodes[index] = current;
+
+          // children are numbered as they are discovered, which keeps the array in breadth first order.
+          for (size_t offset = 0; offset < children.size(); offset++) {
+            static_edges[current.static_begin + offset].node = index_of(children[offset].second);
+          }
+          for (size_t offset = 0; offset < order.size(); offset++) {
+            auto& child = source->dynamic_nodes[order[offset]];
+            dynamic_edges[current.dynamic_begin + offset].node = index_of(child.node.get());
+          }
+        }
+
+        sections_ = {static_edges.size(), nodes.size(), dynamic_edges.size(), method_handlers.size(), keys.size()};
+        auto image = std::make_shared<std::vector<uint64_t>>(sections_.bytes() / sizeof(uint64_t));
+        auto target = reinterpret_cast<char*>(image->data());
+        auto copy = [&target](const void* source, size_t bytes) {
+          if (bytes) std::memcpy(target, source, bytes);
+          target += padded(bytes);
+        };
+        copy(static_edges.data(), sizeof(static_edge) * static_edges.size());
+        copy(nodes.data(), sizeof(node) * nodes.size());
+        copy(dynamic_edges.data(), sizeof(dynamic_edge) * dynamic_edges.size());
+        copy(method_handlers.data(), sizeof(method_row) * method_handlers.size());
+        copy(keys.data(), keys.size());
+        this->map(reinterpret_cast<const char*>(image->data()));
+        image_ = std::move(image);
+      }
+
+      /**
+       * Loads a snapshot written by save(), see GraphRouter::save(). The file is mapped and its image used in place, so
+       * loading allocates nothing per route: its cost is one pass over the image, checking every index in it against
+       * the array it points into, plus one handler, matcher and automaton for each distinct one. Snapshots are only
+       * good on the build that wrote them.
+       *
+       * @param handlers the handlers by the names they were saved with.
+       * @param matchers the router the aliases of the matchers are looked up in, custom aliases need registering there.
+       * @throws std::system_error if the file can't be mapped, std::runtime_error if it's no snapshot of this build and
+       *         RegistryNotFound for handlers or matcher aliases that aren't registered.
+       */
+      static FrozenRouter load(
+        const std::string& file, const utility::registry<std::shared_ptr<T>>& handlers, GraphRouter<T>& matchers
+      ) {
+        auto mapping = std::make_shared<utility::mapped_file>(file);
+        snapshot_header header;
+        if (mapping->size() < sizeof(header)) throw std::runtime_error{file + " is not a router snapshot"};
+        std::memcpy(&header, mapping->data(), sizeof(header));
+        if (std::memcmp(header.magic, snapshot_header{}.magic, sizeof(header.magic)) != 0) {
+          throw std::runtime_error{file + " is not a router snapshot"};
+        }
+        if (header.format != snapshot_header{}.format || header.byte_order != snapshot_header{}.byte_order ||
+            std::memcmp(header.item_sizes, snapshot_header{}.item_sizes, sizeof(header.item_sizes)) != 0) {
+          throw std::runtime_error{file + " is a router snapshot of another format"};
+        }
+        auto counts = {
+          header.sections.static_edges, header.sections.nodes, header.sections.dynamic_edges,
+          header.sections.method_handlers, header.sections.keys, header.dynamic_sets, header.matchers,
+          header.handlers, header.strings
+        };
+        if (std::any_of(begin(counts), end(counts), [&mapping](auto count) { return count > mapping->size(); }) ||
+            header.sections.nodes == 0 || header.size() != mapping->size()) {
+          throw std::runtime_error{file + " is a truncated router snapshot"};
+        }
+
+        FrozenRouter router;
+        router.sections_ = header.sections;
+        auto position = mapping->data() + sizeof(header);
+        router.map(position);
+        position += header.sections.bytes();
+        auto set_edges = reinterpret_cast<const std::array<uint32_t, 2>*>(position);
+        position += padded(sizeof(set_edges[0]) * header.dynamic_sets);
+        auto lengths = reinterpret_cast<const uint32_t*>(position);
+        position += padded(sizeof(lengths[0]) * (header.matchers + header.handlers));
+        auto next_string = [&]() {
+          std::string_view text{position, *lengths++};
+          if (text.size() > static_cast<size_t>(mapping->data() + mapping->size() - position)) {
+            throw std::runtime_error{file + " is a corrupt router snapshot"};
+          }
+          position += text.size();
+          return text;
+        };
+
+        for (uint64_t index = 0; index < header.matchers; index++) {
+          router.matchers_.push_back(matchers.get_matcher(next_string()));
+        }
+        for (uint64_t index = 0; index < header.handlers; index++) {
+          router.handlers_.push_back(handlers[std::string{next_string()}]);
+        }
+        for (uint64_t index = 0; index < header.dynamic_sets; index++) {
+          if (set_edges[index][0] > set_edges[index][1] || set_edges[index][1] > header.sections.dynamic_edges) {
+            throw std::runtime_error{file + " is a corrupt router snapshot"};
+          }
+          std::vector<const PathRegex*> patterns;
+          for (auto edge = set_edges[index][0]; edge < set_edges[index][1]; edge++) {
+            auto matcher = router.dynamic_edges_[edge].matcher;
+            if (matcher >= router.matchers_.size()) throw std::runtime_error{file + " is a corrupt router snapshot"};
+            patterns.push_back(router.matchers_[matcher]->pattern());
+          }
+          auto set = PathRegexSet::compile(patterns);  // nodes without one try every matcher.
+          router.dynamic_sets_.push_back(set ? std::make_shared<PathRegexSet>(std::move(*set)) : nullptr);
+          router.set_edges_.push_back(set_edges[index]);
+        }
+        if (!router.is_consistent()) throw std::runtime_error{file + " is a corrupt router snapshot"};
+        router.image_ = std::move(mapping);
+        return router;
+      }
+
+      /**
+       * Same as load() above, with the built-in matcher aliases only.
+       */
+      static FrozenRouter load(const std::string& file, const utility::registry<std::shared_ptr<T>>& handlers) {
+        GraphRouter<T> matchers;
+        return load(file, handlers, matchers);
+      }
+
+      /**
+       * Writes a snapshot load() can map back, see GraphRouter::save(). The file is written next to its final place
+       * and moved over it once complete, routers still mapping the file it replaces keep working.
+       *
+       * @param matcher_specs the segment each matcher was made for, e.g. "<int:id>".
+       * @param handler_ids the name each handler gets registered under when loading.
+       */
+      void save(const std::string& file, const MatcherSpecs& matcher_specs, const HandlerIds& handler_ids) const {
+        snapshot_header header;
+        header.sections = sections_;
+        header.dynamic_sets = dynamic_sets_.size();
+        header.matchers = matchers_.size();
+        header.handlers = handlers_.size();
+        std::vector<uint32_t> lengths;
+        std::string strings;
+        auto add_string = [&](std::string_view text) {
+          lengths.push_back(static_cast<uint32_t>(text.size()));
+          strings += text;
+        };
+        for (auto& matcher : matchers_) add_string(matcher_specs(*matcher));
+        for (auto& handler : handlers_) add_string(handler_ids(handler));
+        header.strings = strings.size();
+
+        auto temporary = file + ".tmp";
+        {
+          std::ofstream out{temporary, std::ios::binary | std::ios::trunc};
+          auto write = [&out](const void* source, size_t bytes) {
+            static const char padding[sizeof(uint64_t)] = {};
+            out.write(static_cast<const char*>(source), static_cast<std::streamsize>(bytes));
+            out.write(padding, static_cast<std::streamsize>(padded(bytes) - bytes));
+          };
+          write(&header, sizeof(header));
+          write(image_start(), sections_.bytes());
+          write(set_edges_.data(), sizeof(set_edges_[0]) * set_edges_.size());
+          write(lengths.data(), sizeof(lengths[0]) * lengths.size());
+          out.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+          if (!out.flush()) throw std::runtime_error{"can't write " + temporary};
+        }
+        if (std::rename(temporary.c_str(), file.c_str()) != 0) {
+          std::remove(temporary.c_str());
+          throw std::runtime_error{"can't move " + temporary + " to " + file};
+        }
+      }
+
+      ResolveResult<T> resolve(std::string_view path) const override {
+        ResolveResult<T> result{};
+        if (auto head = this->find_node(path, result.params)) this->set_handler(*head, head->handler, result);
+        return result;
+      }
+
+      ResolveResult<T> resolve(HttpMethod method, std::string_view path) const override {
+        ResolveResult<T> result{};
+        if (auto head = this->find_node(path, result.params)) {
+          auto handler = head->handler;
+          auto index = method_index(method);
+          if (head->method_handlers >= 0 && index >= 0 && method_handlers_[head->method_handlers][index] >= 0) {
+            handler = method_handlers_[head->method_handlers][index];
+          }
+          this->set_handler(*head, handler, result);
+        }
+        return result;
+      }
+
+      size_t size() const noexcept { return sections_.nodes; }
+
+    private:
+      struct node {
+        uint32_t static_begin = 0;
+        uint32_t static_end = 0;
+        uint32_t dynamic_begin = 0;
+        uint32_t dynamic_end = 0;
+        int32_t dynamic_set = -1;
+        int32_t handler = -1;
+        int32_t method_handlers = -1;  // a row of method_handlers_ for nodes with handlers for single methods.
+        HttpMethods allowed;
+        uint16_t reserved = 0;
+      };
+
+      struct static_edge {
+        uint64_t hash;
+        uint32_t key_offset;
+        uint32_t key_length;
+        uint32_t node;
+        uint32_t reserved = 0;
+      };
+
+      struct dynamic_edge {
+        uint32_t matcher;
+        uint32_t node;
+        uint8_t consumes_remainder;  // not a bool, a snapshot may hold any byte there.
+        uint8_t reserved[3] = {};
+      };
+
+      // the image gets written out byte for byte, padding would write whatever the stack had there.
+      static_assert(std::has_unique_object_representations_v<node>, "nodes must have no padding");
+      static_assert(std::has_unique_object_representations_v<static_edge>, "static edges must have no padding");
+      static_assert(std::has_unique_object_representations_v<dynamic_edge>, "dynamic edges must have no padding");
+
+      typedef std::array<int32_t, http_method_count> method_row;  // indices of handlers_, -1 for none.
+
+      /**
+       * Number of items in each array of the image, in the order they are laid out in. Every array starts at a multiple
+       * of eight bytes.
+       */
+      struct image_sections {
+        uint64_t static_edges = 0;
+        uint64_t nodes = 0;
+        uint64_t dynamic_edges = 0;
+        uint64_t method_handlers = 0;
+        uint64_t keys = 0;
+
+        uint64_t bytes() const noexcept {
+          return padded(sizeof(static_edge) * static_edges) + padded(sizeof(node) * nodes) +
+                 padded(sizeof(dynamic_edge) * dynamic_edges) + padded(sizeof(method_row) * method_handlers) +
+                 padded(keys);
+        }
+      };
+
+      /**
+       * The start of a snapshot, followed by the image, the range of edges each automaton is compiled from, the lengths
+       * of the strings and the strings themselves: the segments of the matchers, then the names of the handlers.
+       */
+      struct snapshot_header {
+        char magic[8] = {'S', 'U', 'S', 'P', 'R', 'O', 'U', 'T'};
+        uint32_t format = 1;
+        uint32_t byte_order = 0x01020304;
+        uint32_t item_sizes[4] = {sizeof(static_edge), sizeof(node), sizeof(dynamic_edge), sizeof(method_row)};
+        image_sections sections;
+        uint64_t dynamic_sets = 0;
+        uint64_t matchers = 0;
+        uint64_t handlers = 0;
+        uint64_t strings = 0;  // characters in all strings together.
+
+        uint64_t size() const noexcept {
+          return sizeof(snapshot_header) + sections.bytes() + padded(sizeof(uint32_t) * 2 * dynamic_sets) +
+                 padded(sizeof(uint32_t) * (matchers + handlers)) + strings;
+        }
+      };
+      static_assert(sizeof(snapshot_header) % sizeof(uint64_t) == 0, "the image must start aligned");
+      static_assert(std::has_unique_object_representations_v<snapshot_header>, "headers must have no padding");
+
+      FrozenRouter() = default;
+
+      static constexpr uint64_t padded(uint64_t bytes) noexcept {
+        return (bytes + sizeof(uint64_t) - 1) & ~uint64_t{sizeof(uint64_t) - 1};
+      }
+
+      /**
+       * FNV-1a, cheap on the short names paths are made of.
+       */
+      static uint64_t hash(std::string_view text) noexcept {
+        uint64_t value = 14695981039346656037ull;
+        for (auto character : text) value = (value ^ static_cast<unsigned char>(character)) * 1099511628211ull;
+        return value;
+      }
+
+      /**
+       * Points the arrays at an image laid out as sections_ says.
+       */
+      void map(const char* image) noexcept {
+        static_edges_ = reinterpret_cast<const static_edge*>(image);
+        image += padded(sizeof(static_edge) * sections_.static_edges);
+        nodes_ = reinterpret_cast<const node*>(image);
+        image += padded(sizeof(node) * sections_.nodes);
+        dynamic_edges_ = reinterpret_cast<const dynamic_edge*>(image);
+        image += padded(sizeof(dynamic_edge) * sections_.dynamic_edges);
+        method_handlers_ = reinterpret_cast<const method_row*>(image);
+        image += padded(sizeof(method_row) * sections_.method_handlers);
+        keys_ = image;
+      }
+
+      const char* image_start() const noexcept { return reinterpret_cast<const char*>(static_edges_); }
+
+      /**
+       * Whether every index in the image points inside the array it's for, which is all resolve() needs to stay in
+       * bounds whatever the image holds.
+       */
+      bool is_consistent() const noexcept {
+        auto in = [](int64_t index, uint64_t size) { return index >= -1 && index < static_cast<int64_t>(size); };
+        for (uint64_t index = 0; index < sections_.static_edges; index++) {
+          auto& edge = static_edges_[index];
+          if (edge.node >= sections_.nodes || edge.key_offset > sections_.keys ||
+              edge.key_length > sections_.keys - edge.key_offset) {
+            return false;
+          }
+        }
+        for (uint64_t index = 0; index < sections_.dynamic_edges; index++) {
+          auto& edge = dynamic_edges_[index];
+          if (edge.node >= sections_.nodes || edge.matcher >= matchers_.size()) return false;
+        }
+        for (uint64_t index = 0; index < sections_.method_handlers; index++) {
+          for (auto handler : method_handlers_[index]) {
+            if (!in(handler, handlers_.size())) return false;
+          }
+        }
+        for (uint64_t index = 0; index < sections_.nodes; index++) {
+          auto& item = nodes_[index];
+          if (item.static_begin > item.static_end || item.static_end > sections_.static_edges ||
+              item.dynamic_begin > item.dynamic_end || item.dynamic_end > sections_.dynamic_edges ||
+              !in(item.dynamic_set, dynamic_sets_.size()) || !in(item.handler, handlers_.size()) ||
+              !in(item.method_handlers, sections_.method_handlers)) {
+            return false;
+          }
+          // the automaton picks edges by their offset from dynamic_begin, its range has to be the node's own.
+          if (item.dynamic_set >= 0) {
+            auto& edges = set_edges_[item.dynamic_set];
+            if (edges[1] - edges[0] != item.dynamic_end - item.dynamic_begin) return false;
+          }
+        }
+        return true;
+      }
+
+      std::string_view key(const static_edge& edge) const noexcept {
+        return {keys_ + edge.key_offset, edge.key_length};
+      }
+
+      const node* find_node(std::string_view path, RouteParams& params) const {
+        const node* head = nodes_;
+        utility::string_partitioner it{path};
+        std::string_view route;
+        while (it.next(route)) {
+          auto remainder = path.substr(static_cast<size_t>(route.data() - path.data()));
+          bool consumed = false;
+          if (auto node = this->resolve(*head, route, remainder, params, consumed)) {
+            head = node;
+            if (consumed) break;
+          } else {
+            return nullptr;
+          }
+        }
+        return head;
+      }
+
+      void set_handler(const node& head, int32_t handler, ResolveResult<T>& result) const {
+        result.allowed = head.allowed;
+        if (handler >= 0) {
+          result.matched = true;
+          result.handler = handlers_[handler];
+        }
+      }
+
+      const node* resolve(
+        const node& head, std::string_view route, std::string_view remainder, RouteParams& params, bool& consumed
+      ) const {
+        if (head.static_begin != head.static_end) {
+          auto first = static_edges_ + head.static_begin, last = static_edges_ + head.static_end;
+          auto route_hash = hash(route);
+          auto it = std::lower_bound(first, last, route_hash, [](auto& edge, auto value) { return edge.hash < value; });
+          for (; it != last && it->hash == route_hash; it++) {
+            if (this->key(*it) == route) return &nodes_[it->node];
+          }
+        }
+
+        auto matches = [&](const dynamic_edge& edge) {
+          consumed = edge.consumes_remainder;
+          return matchers_[edge.matcher]->match(consumed ? remainder : route, params);
+        };
+        if (head.dynamic_set >= 0 && dynamic_sets_[head.dynamic_set]) {
+          for (auto offset : dynamic_sets_[head.dynamic_set]->match(route)) {
+            auto& edge = dynamic_edges_[head.dynamic_begin + offset];
+            if (matches(edge)) return &nodes_[edge.node];
+          }
+          return nullptr;
+        }
+        for (auto index = head.dynamic_begin; index < head.dynamic_end; index++) {
+          auto& edge = dynamic_edges_[index];
+          if (matches(edge)) return &nodes_[edge.node];
+        }
+        return nullptr;
+      }
+
+      std::shared_ptr<const void> image_;  // owns the arrays below, a buffer of its own or a mapped snapshot.
+      image_sections sections_;
+      const static_edge* static_edges_ = nullptr;
+      const node* nodes_ = nullptr;
+      const dynamic_edge* dynamic_edges_ = nullptr;
+      const method_row* method_handlers_ = nullptr;
+      const char* keys_ = nullptr;
+      std::vector<std::shared_ptr<RouteMatcher>> matchers_;
+      std::vector<std::shared_ptr<const PathRegexSet>> dynamic_sets_;  // shared with the nodes they were frozen from.
+      std::vector<std::array<uint32_t, 2>> set_edges_;  // the range of edges each automaton was compiled from.
+      std::vector<std::shared_ptr<T>> handlers_;
+    };
+
+
+    template<class T>
+    FrozenRouter<T> GraphRouter<T>::freeze() const {
+      return FrozenRouter<T>{root_};
+    }
+
+    template<class T>
+    void GraphRouter<T>::save(
+      const std::string& file, const std::function<std::string(const std::shared_ptr<T>&)>& handler_ids
+    ) const {
+      std::unordered_map<const RouteMatcher*, std::string_view> specs;
+      for (auto& item : matchers_) specs.emplace(item.second.get(), item.first);
+      this->freeze().save(file, [&specs](const RouteMatcher& matcher) {
+        auto it = specs.find(&matcher);
+        if (it == end(specs)) throw std::invalid_argument{"can't save a matcher that wasn't added with a route"};
+        return it->second;
+      }, handler_ids);
+    }
+
+  }
+
+}
+
+#endif //SUSPIRIA_FROZEN_ROUTER_H
@@ -5,10 +5,20 @@
 #ifndef SUSPIRIA_GRAPH_ROUTER_H
 #define SUSPIRIA_GRAPH_ROUTER_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <forward_list>
+#include <istream>
+#include <optional>
 #include <regex>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
+#include "path_regex.h"
 #include "router.h"
 #include "susperia/internal/utility.h"
 
@@ -28,7 +38,19 @@ namespace suspiria {
     class RouteMatcher {
     public:
       virtual ~RouteMatcher() = default;
-      virtual bool match(const std::string& route, RouteParams& params) const noexcept = 0;
+      virtual bool match(std::string_view route, RouteParams& params) const noexcept = 0;
+
+      /**
+       * A pattern that matches at least every route this matcher accepts, or nullptr if there is no such pattern. Nodes
+       * run the patterns of all their dynamic children at once to find out which matchers are worth trying.
+       */
+      virtual const PathRegex* pattern() const noexcept { return nullptr; }
+
+      /**
+       * Whether the matcher gets the rest of the path, from the segment it is at to the very end, instead of a single
+       * segment. Resolving stops at the node of such a matcher, whatever is left of the path is its to match.
+       */
+      virtual bool consumes_remainder() const noexcept { return false; }
     };
 
     /**
@@ -41,11 +63,14 @@ namespace suspiria {
       explicit RegexRouteMatcher(const std::string& pattern, const std::vector<std::string>& capture_names);
       explicit RegexRouteMatcher(const std::string& pattern, std::vector<std::string>&& capture_names);
 
-      bool match(const std::string &route, RouteParams &params) const noexcept override;
+      bool match(std::string_view route, RouteParams &params) const noexcept override;
+
+      const PathRegex* pattern() const noexcept override { return compiled_ ? &*compiled_ : nullptr; }
 
       static std::shared_ptr<RegexRouteMatcher> create_from_args(RouteMatcherArgs&& args);
 
     private:
+      std::optional<PathRegex> compiled_;  // patterns PathRegex doesn't support fall back on std::regex.
       std::regex pattern_;
       std::vector<std::string> names_;
     };
@@ -57,8 +82,8 @@ namespace suspiria {
     public:
       explicit VariableRouteMatcher(std::string name) : name_(std::move(name)) {}
 
-      bool match(const std::string &route, RouteParams &params) const noexcept override {
-        params[name_] = route;
+      bool match(std::string_view route, RouteParams &params) const noexcept override {
+        params.set(name_, route);
         return true;
       }
 
@@ -71,6 +96,109 @@ namespace suspiria {
       std::string name_;
     };
 
+    /**
+     * Matches the rest of the path in one step and puts it in the route parameters as is, slashes and all. For instance
+     * "/static/<path:file>" matches "/static/css/site.css" with "css/site.css" as the file. It needs at least one more
+     * segment to match, "/static" alone is left to the node it resolves to.
+     */
+    class PathRouteMatcher : public RouteMatcher {
+    public:
+      explicit PathRouteMatcher(std::string name) : name_(std::move(name)) {}
+
+      bool match(std::string_view route, RouteParams &params) const noexcept override {
+        params.set(name_, route);
+        return true;
+      }
+
+      bool consumes_remainder() const noexcept override { return true; }
+
+      static std::shared_ptr<PathRouteMatcher> create_from_args(RouteMatcherArgs&& args) {
+        if (args.empty()) throw std::invalid_argument("missing name from the args");
+        return std::make_shared<PathRouteMatcher>(args[0]);
+      }
+
+    private:
+      std::string name_;
+    };
+
+    /**
+     * Matches the segments a validator accepts and puts them in the route parameters along with the value the validator
+     * parsed out of them. Validators are plain hand written loops, a good deal cheaper than a regular expression doing
+     * the same job. See the aliases registered by GraphRouter for the available ones, e.g. <int:id> or <uuid:id>.
+     */
+    template<typename Validator>
+    class TypedRouteMatcher : public RouteMatcher {
+    public:
+      explicit TypedRouteMatcher(std::string name) : name_(std::move(name)) {}
+
+      bool match(std::string_view route, RouteParams &params) const noexcept override {
+        RouteParams::typed_value value;
+        if (!Validator::parse(route, value)) return false;
+        params.set(name_, route, value);
+        return true;
+      }
+
+      const PathRegex* pattern() const noexcept override {
+        static const auto compiled = PathRegex::compile(Validator::pattern);
+        return compiled ? &*compiled : nullptr;
+      }
+
+      static std::shared_ptr<TypedRouteMatcher> create_from_args(RouteMatcherArgs&& args) {
+        if (args.empty()) throw std::invalid_argument("missing name from the args");
+        return std::make_shared<TypedRouteMatcher>(args[0]);
+      }
+
+    private:
+      std::string name_;
+    };
+
+    /**
+     * A signed 64 bit decimal integer, i.e. -?\d+ without overflowing.
+     */
+    struct IntValidator {
+      static constexpr std::string_view pattern = R"(-?\d+)";
+      static bool parse(std::string_view text, RouteParams::typed_value& value) noexcept;
+    };
+
+    /**
+     * An unsigned 64 bit decimal integer, i.e. \d+ without overflowing.
+     */
+    struct UintValidator {
+      static constexpr std::string_view pattern = R"(\d+)";
+      static bool parse(std::string_view text, RouteParams::typed_value& value) noexcept;
+    };
+
+    /**
+     * A UUID in its canonical 8-4-4-4-12 hex digits form, in any case.
+     */
+    struct UuidValidator {
+      static constexpr std::string_view pattern = R"([\da-fA-F]{8}-[\da-fA-F]{4}-[\da-fA-F]{4}-)"
+                                                  R"([\da-fA-F]{4}-[\da-fA-F]{12})";
+      static bool parse(std::string_view text, RouteParams::typed_value& value) noexcept;
+    };
+
+    /**
+     * ASCII letters, digits, hyphens and underscores. There is nothing to parse, the value is the segment itself.
+     */
+    struct SlugValidator {
+      static constexpr std::string_view pattern = R"([\w-]+)";
+      static bool parse(std::string_view text, RouteParams::typed_value& value) noexcept;
+    };
+
+    /**
+     * Hex digits in any case. Values that fit in 64 bits are parsed as well.
+     */
+    struct HexValidator {
+      static constexpr std::string_view pattern = R"([\da-fA-F]+)";
+      static bool parse(std::string_view text, RouteParams::typed_value& value) noexcept;
+    };
+
+    typedef TypedRouteMatcher<IntValidator> IntRouteMatcher;
+    typedef TypedRouteMatcher<UintValidator> UintRouteMatcher;
+    typedef TypedRouteMatcher<UuidValidator> UuidRouteMatcher;
+    typedef TypedRouteMatcher<SlugValidator> SlugRouteMatcher;
+    typedef TypedRouteMatcher<HexValidator> HexRouteMatcher;
+
     /** GraphRouter comes with a fleet of specialty classes that accommodate graph routing, a fast generic routing tool.
      */
     template<class T>
@@ -80,25 +208,109 @@ namespace suspiria {
         size_t hash = 0;
         std::shared_ptr<RouteMatcher> matcher;
         std::shared_ptr<RouterNode> node;
+        bool consumes_remainder = false;  // same as the matcher's, see RouteMatcher::consumes_remainder().
       };
 
+      RouterNode() = default;
+      RouterNode(const RouterNode&) = delete;  // static_nodes is keyed by views into the node's own names.
+
       std::string name;
-      std::unordered_map<std::string, std::shared_ptr<RouterNode>> static_nodes;
+      std::unordered_map<std::string_view, std::shared_ptr<RouterNode>> static_nodes;  // use add_node() to add to it.
       std::vector<dynamic_node> dynamic_nodes;
-      std::shared_ptr<T> handler = nullptr;
+      std::shared_ptr<T> handler = nullptr;  // handles the methods that have no handler of their own.
+
+      /**
+       * Sets or, given nullptr, removes the handler of a single method.
+       */
+      void set_handler(HttpMethod method, std::shared_ptr<T> method_handler) {
+        auto index = method_index(method);
+        if (index < 0) throw std::invalid_argument{"routes can't be registered for this method"};
+        if (method_handler) {
+          methods_.add(method);
+        } else {
+          methods_.remove(method);
+        }
+        method_handlers_[index] = std::move(method_handler);
+      }
 
-      void add_node(std::string name, std::shared_ptr<RouterNode> node) {
-        this->static_nodes[std::move(name)] = std::move(node);
+      /**
+       * @return The handler of the method or the handler of every method if it has none.
+       */
+      const std::shared_ptr<T>& get_handler(HttpMethod method) const noexcept {
+        auto index = method_index(method);
+        if (index >= 0 && method_handlers_[index]) return method_handlers_[index];
+        return handler;
       }
 
-      std::shared_ptr<RouterNode> get_static_node(const std::string& name) const noexcept {
+      /**
+       * The methods that have handlers of their own.
+       */
+      HttpMethods methods() const noexcept { return methods_; }
+
+      HttpMethods allowed_methods() const noexcept { return handler ? HttpMethods::all() : methods_; }
+
+      /**
+       * Adds or replaces a static child. The node keeps its own copy of the name and keys static_nodes by a view of it,
+       * that way paths can be looked up segment by segment without turning the segments into strings first.
+       */
+      void add_node(std::string_view name, std::shared_ptr<RouterNode> node) {
+        auto it = static_nodes.find(name);
+        if (it != end(static_nodes)) {
+          it->second = std::move(node);
+        } else {
+          static_nodes.emplace(static_names_.emplace_front(name), std::move(node));
+        }
+      }
+
+      std::shared_ptr<RouterNode> get_static_node(std::string_view name) const noexcept {
         auto it = static_nodes.find(name);
         if (it == end(static_nodes)) return nullptr;
         return it->second;
       }
 
-      void add_node(size_t hash, std::shared_ptr<RouteMatcher> matcher, std::shared_ptr<RouterNode> node) {
-        this->dynamic_nodes.emplace_back(dynamic_node{hash, std::move(matcher), std::move(node)});
+      /**
+       * Adds a dynamic child and compiles the patterns of all of them again, unless told not to. Adding many children
+       * at once is cheaper without it, compile_dynamic_nodes() once they are all in.
+       */
+      void add_node(
+        size_t hash, std::shared_ptr<RouteMatcher> matcher, std::shared_ptr<RouterNode> node, bool compile=true
+      ) {
+        auto consumes_remainder = matcher->consumes_remainder();
+        this->dynamic_nodes.emplace_back(dynamic_node{hash, std::move(matcher), std::move(node), consumes_remainder});
+        if (compile) this->compile_dynamic_nodes();
+      }
+
+      /**
+       * Turns the adaptive order of the dynamic children on or off. Nodes with children too many or too complex to
+       * share an automaton (see get_dynamic_set()) try their matchers one after the other, in the adaptive order the
+       * ones that match most often get tried first. The order is worked out again every so many matches, with the
+       * older matches counting less and less. Two children only ever trade places if their patterns prove no segment
+       * matches both, children that could both match a segment are ambiguous and keep the order they were added in.
+       *
+       * It only applies to nodes whose automaton couldn't be built: 2 to 16 dynamic children, at least one of them
+       * with a pattern, whose combined DFA would outgrow PathRegexSet::compile(). Every other node either has an
+       * automaton, which already skips the children that can't match, or tries its children in the order they were
+       * added. In practice that takes many or large regex matchers, the typed ones (int, uuid, slug, ...) are small
+       * enough to share one.
+       */
+      void set_adaptive(bool adaptive) {
+        adaptive_ = adaptive;
+        this->compile_dynamic_nodes();
+      }
+
+      bool is_adaptive() const noexcept { return adaptive_; }
+
+      /**
+       * Indices of dynamic_nodes in the order their matchers are tried in when there's no automaton.
+       */
+      std::vector<size_t> dynamic_order() const {
+        std::vector<size_t> result;
+        auto adaptive = this->get_adaptive_order();
+        auto order = adaptive ? adaptive->order.load(std::memory_order_relaxed) : 0;
+        for (size_t position = 0; position < dynamic_nodes.size(); position++, order >>= adaptive_order::index_bits) {
+          result.push_back(adaptive ? static_cast<size_t>(order & adaptive_order::index_mask) : position);
+        }
+        return result;
       }
 
       std::shared_ptr<RouterNode> get_dynamic_node(const size_t& hash) const noexcept {
@@ -108,8 +320,148 @@ namespace suspiria {
         if (it == end(dynamic_nodes)) return nullptr;
         return it->node;
       }
+
+      /**
+       * The patterns of the dynamic children compiled into one automaton, nullptr if there's no point in having one or
+       * dynamic_nodes changed without going through add_node().
+       */
+      std::shared_ptr<const PathRegexSet> get_dynamic_set() const noexcept {
+        if (!dynamic_set_ || dynamic_set_->size() != dynamic_nodes.size()) return nullptr;
+        return dynamic_set_;
+      }
+
+      /**
+       * Finds the first dynamic child, in the order they were added, whose matcher accepts the route. The automaton
+       * rules out the children whose pattern doesn't match in a single pass, only the rest get their matchers run.
+       * Without one the children are tried in dynamic_order(), which gives the same result.
+       * @param route The segment to match.
+       * @param remainder The rest of the path starting with the segment, for the matchers that consume it.
+       */
+      const dynamic_node* match_dynamic_node(
+        std::string_view route, std::string_view remainder, RouteParams& params
+      ) const noexcept {
+        auto matches = [&](const dynamic_node& item) {
+          return item.matcher->match(item.consumes_remainder ? remainder : route, params);
+        };
+        if (auto set = this->get_dynamic_set()) {
+          for (auto index : set->match(route)) {
+            if (matches(dynamic_nodes[index])) return &dynamic_nodes[index];
+          }
+          return nullptr;
+        }
+        if (auto adaptive = this->get_adaptive_order()) {
+          auto order = adaptive->order.load(std::memory_order_relaxed);
+          for (size_t position = 0; position < dynamic_nodes.size(); position++, order >>= adaptive_order::index_bits) {
+            auto index = static_cast<size_t>(order & adaptive_order::index_mask);
+            if (matches(dynamic_nodes[index])) {
+              this->count_match(*adaptive, index);
+              return &dynamic_nodes[index];
+            }
+          }
+          return nullptr;
+        }
+        for (auto& item : dynamic_nodes) {
+          if (matches(item)) return &item;
+        }
+        return nullptr;
+      }
+
+      /**
+       * Compiles the patterns of the dynamic children into one automaton (see get_dynamic_set()) and works out their
+       * adaptive order if there's no automaton and it's on.
+       */
+      void compile_dynamic_nodes() {
+        dynamic_set_ = nullptr;
+        adaptive_order_ = nullptr;
+        if (dynamic_nodes.size() < 2) return;  // a single matcher checks its own pattern.
+        std::vector<const PathRegex*> patterns;
+        for (auto& item : dynamic_nodes) patterns.push_back(item.matcher->pattern());
+        if (std::none_of(begin(patterns), end(patterns), [](auto pattern) { return pattern; })) return;
+        if (auto set = PathRegexSet::compile(patterns)) {
+          // children that are both worth trying for a segment could both match it, the order they're tried in is fixed.
+          dynamic_set_ = std::make_shared<PathRegexSet>(std::move(*set));
+          return;
+        }
+        if (!adaptive_ || patterns.size() > adaptive_order::max_nodes) return;
+
+        adaptive_order_ = std::make_unique<adaptive_order>();
+        adaptive_order_->size = patterns.size();
+        uint64_t order = 0;
+        for (size_t first = 0; first < patterns.size(); first++) {
+          order |= static_cast<uint64_t>(first) << (adaptive_order::index_bits * first);
+          for (size_t second = first + 1; second < patterns.size(); second++) {
+            if (!patterns[first] || !patterns[second] || !patterns[first]->disjoint(*patterns[second])) continue;
+            adaptive_order_->exclusive[first] |= 1u << second;
+            adaptive_order_->exclusive[second] |= 1u << first;
+          }
+        }
+        adaptive_order_->order.store(order, std::memory_order_relaxed);
+      }
+
+    private:
+      /**
+       * The adaptive order of the dynamic children, packed in a single word so that resolving always sees a whole one.
+       * Match counts are approximate, matches counted while the order is being worked out might get lost.
+       */
+      struct adaptive_order {
+        static constexpr size_t max_nodes = 16;
+        static constexpr size_t index_bits = 4;
+        static constexpr uint64_t index_mask = (1u << index_bits) - 1;
+        static constexpr int32_t interval = 1024;  // matches between two reorders.
+
+        size_t size = 0;
+        std::array<uint16_t, max_nodes> exclusive{};  // bit j of exclusive[i]: no segment matches both i and j.
+        mutable std::array<std::atomic<uint32_t>, max_nodes> matches{};
+        mutable std::atomic<uint64_t> order{0};  // the index of the child tried in position p is at bit index_bits * p.
+        mutable std::atomic<int32_t> countdown{interval};
+      };
+
+      const adaptive_order* get_adaptive_order() const noexcept {
+        if (!adaptive_order_ || adaptive_order_->size != dynamic_nodes.size()) return nullptr;
+        return adaptive_order_.get();
+      }
+
+      static void count_match(const adaptive_order& adaptive, size_t index) noexcept {
+        adaptive.matches[index].fetch_add(1, std::memory_order_relaxed);
+        if (adaptive.countdown.fetch_sub(1, std::memory_order_relaxed) != 1) return;  // one thread reorders.
+
+        uint32_t counts[adaptive_order::max_nodes];
+        size_t positions[adaptive_order::max_nodes];
+        auto order = adaptive.order.load(std::memory_order_relaxed);
+        for (size_t position = 0; position < adaptive.size; position++) {
+          counts[position] = adaptive.matches[position].load(std::memory_order_relaxed);  // by index, not position.
+          positions[position] = static_cast<size_t>(order >> (adaptive_order::index_bits * position)) &
+                                adaptive_order::index_mask;
+        }
+        // only neighbours that are exclusive trade places, which keeps ambiguous children in the order they were added.
+        for (bool swapped = true; swapped;) {
+          swapped = false;
+          for (size_t position = 0; position + 1 < adaptive.size; position++) {
+            auto first = positions[position], second = positions[position + 1];
+            if (counts[second] <= counts[first] || !(adaptive.exclusive[first] & (1u << second))) continue;
+            std::swap(positions[position], positions[position + 1]);
+            swapped = true;
+          }
+        }
+        order = 0;
+        for (size_t position = 0; position < adaptive.size; position++) {
+          order |= static_cast<uint64_t>(positions[position]) << (adaptive_order::index_bits * position);
+          adaptive.matches[position].store(counts[position] / 2, std::memory_order_relaxed);
+        }
+        adaptive.order.store(order, std::memory_order_relaxed);
+        adaptive.countdown.store(adaptive_order::interval, std::memory_order_relaxed);
+      }
+
+      std::forward_list<std::string> static_names_;
+      std::shared_ptr<const PathRegexSet> dynamic_set_;
+      std::unique_ptr<adaptive_order> adaptive_order_;
+      bool adaptive_ = false;
+      std::array<std::shared_ptr<T>, http_method_count> method_handlers_;
+      HttpMethods methods_;
     };
 
+    template<class T> class FrozenRouter;
+
     template<class T>
     class GraphRouter : public Router<T> {
     public:
@@ -119,13 +471,26 @@ namespace suspiria {
         // Register the basic route matchers.
         this->add_route_matcher_alias("", &VariableRouteMatcher::create_from_args);
         this->add_route_matcher_alias("re", &RegexRouteMatcher::create_from_args);
+        this->add_route_matcher_alias("int", &IntRouteMatcher::create_from_args);
+        this->add_route_matcher_alias("uint", &UintRouteMatcher::create_from_args);
+        this->add_route_matcher_alias("uuid", &UuidRouteMatcher::create_from_args);
+        this->add_route_matcher_alias("slug", &SlugRouteMatcher::create_from_args);
+        this->add_route_matcher_alias("hex", &HexRouteMatcher::create_from_args);
+        this->add_route_matcher_alias("path", &PathRouteMatcher::create_from_args);
       };
 
       RouterNode<T>& add_route(const std::string& path, const RouterNode<T>& node, const std::string& name="") {
         auto new_root = this->mk_route(path);
         new_root->handler = node.handler;
-        new_root->static_nodes.insert(begin(node.static_nodes), end(node.static_nodes));
-        std::copy(begin(node.dynamic_nodes), end(node.dynamic_nodes), std::back_inserter(new_root->dynamic_nodes));
+        for (size_t index = 0; index < http_method_count; index++) {
+          auto method = method_at(index);
+          if (node.methods().contains(method)) new_root->set_handler(method, node.get_handler(method));
+        }
+        for (auto& item : node.static_nodes) {
+          if (!new_root->get_static_node(item.first)) new_root->add_node(item.first, item.second);
+        }
+        for (auto& item : node.dynamic_nodes) new_root->add_node(item.hash, item.matcher, item.node);
+        version_++;
         return *new_root;
       }
 
@@ -141,30 +506,125 @@ namespace suspiria {
         auto node = this->mk_route(path);
         node->handler = move(handler);
         node->name = name;
+        version_++;
         return *node;
       }
 
+      /**
+       * Adds a new route the same way, with a handler for a single method. Paths can have a handler for every method
+       * and one for all of the rest, see resolve(method, path).
+       */
+      RouterNode<T>& add_route(
+        HttpMethod method, const std::string& path, std::shared_ptr<T> handler, const std::string& name=""
+      ) {
+        auto node = this->mk_route(path);
+        node->set_handler(method, move(handler));
+        if (!name.empty()) node->name = name;
+        version_++;
+        return *node;
+      }
+
+      /**
+       * A route for add_routes(), for every method unless it has one.
+       */
+      struct route_entry {
+        std::optional<HttpMethod> method;
+        std::string path;
+        std::shared_ptr<T> handler;
+        std::string name;
+      };
+
+      /**
+       * Adds many routes at once, the same as adding them one by one only faster: nodes compile the patterns of their
+       * dynamic children once all of the routes are in, instead of once per child.
+       * @tparam Iterator Iterates over route_entry.
+       */
+      template<typename Iterator>
+      void add_routes(Iterator first, Iterator last) {
+        std::unordered_set<RouterNode<T>*> deferred;
+        auto compile = [&]() {
+          for (auto node : deferred) node->compile_dynamic_nodes();
+          version_++;
+        };
+        try {
+          for (; first != last; ++first) this->add_route(*first, &deferred);
+        } catch (...) {
+          compile();  // the routes added before the one that failed stay.
+          throw;
+        }
+        compile();
+      }
+
+      /**
+       * Adds the routes of a text, e.g. a file, one per line: an optional method, the path, the name of the handler and
+       * an optional name for the route, separated by spaces. For instance "GET /users/<int:id> get_user". Empty lines
+       * and lines starting with # are skipped. Nothing is added if a line is malformed.
+       * @param handlers Gives the handler of a name, nullptr for names it doesn't know, which makes the line malformed.
+       * @return The number of routes added.
+       */
+      size_t add_routes(std::istream& input, const std::function<std::shared_ptr<T>(std::string_view)>& handlers) {
+        std::vector<route_entry> entries;
+        std::string line;
+        for (size_t number = 1; std::getline(input, line); number++) {
+          std::replace_if(begin(line), end(line), [](char character) {
+            return std::isspace(static_cast<unsigned char>(character));
+          }, ' ');
+          std::vector<std::string_view> words;
+          utility::string_partitioner it{line, ' '};
+          std::string_view word;
+          while (it.next(word)) words.push_back(word);
+          if (words.empty() || words.front().front() == '#') continue;
+
+          auto error = [&number](const std::string& message) {
+            return std::invalid_argument{"line " + std::to_string(number) + ": " + message};
+          };
+          route_entry entry;
+          if (words.front().front() != '/') {
+            entry.method = method_from_string(words.front());
+            if (!entry.method) throw error("unknown method " + std::string{words.front()});
+            words.erase(begin(words));
+          }
+          if (words.size() < 2 || words.size() > 3) throw error("expected a path, a handler and maybe a name");
+          entry.path = words[0];
+          entry.handler = handlers(words[1]);
+          if (!entry.handler) throw error("unknown handler " + std::string{words[1]});
+          if (words.size() == 3) entry.name = words[2];
+          entries.push_back(std::move(entry));
+        }
+        this->add_routes(begin(entries), end(entries));
+        return entries.size();
+      }
+
       /**
        * Returns a ResolveResult containing the matched handler with its matched keyed parameter list if there is
        * actually a match.
        * @param path The resource path.
        * @return
        */
-      ResolveResult<T> resolve(const std::string &path) const override {
+      ResolveResult<T> resolve(std::string_view path) const override {
         ResolveResult<T> result{};
-        const RouterNode<T>* head = &this->root_;
-        utility::string_partitioner it{path};
-        std::string route;
-        while (it.next(route)) {
-          if(auto node = this->resolve(head, route, result.params)) {
-            head = node;
-          } else {
-            return result;
+        if (auto node = this->find_node(path, result.params)) {
+          result.allowed = node->allowed_methods();
+          if (node->handler) {
+            result.matched = true;
+            result.handler = node->handler;
           }
         }
-        if (head->handler) {
-          result.matched = true;
-          result.handler = head->handler;
+        return result;
+      }
+
+      /**
+       * Same as resolve(path) for a single method: if the path exists but has no handler for the method, the result
+       * doesn't match and has the methods that do have handlers in allowed.
+       */
+      ResolveResult<T> resolve(HttpMethod method, std::string_view path) const override {
+        ResolveResult<T> result{};
+        if (auto node = this->find_node(path, result.params)) {
+          result.allowed = node->allowed_methods();
+          if (auto& handler = node->get_handler(method)) {
+            result.matched = true;
+            result.handler = handler;
+          }
         }
         return result;
       }
@@ -181,84 +641,193 @@ namespace suspiria {
         this->matcher_factory_registry_.add(std::move(alias), std::move(builder));
       }
 
-      RouterNode<T>& get_root() noexcept { return root_; }
+      /**
+       * Turns the adaptive order of dynamic children (see RouterNode::set_adaptive()) on or off for every node, the
+       * ones routes get added to later included. Like adding routes, it can't be done while paths are being resolved.
+       */
+      void set_adaptive(bool adaptive) {
+        adaptive_ = adaptive;
+        std::unordered_set<RouterNode<T>*> visited{&root_};
+        std::vector<RouterNode<T>*> pending{&root_};
+        while (!pending.empty()) {
+          auto node = pending.back();
+          pending.pop_back();
+          node->set_adaptive(adaptive);
+          auto visit = [&](auto& child) { if (visited.insert(child.get()).second) pending.push_back(child.get()); };
+          for (auto& item : node->static_nodes) visit(item.second);
+          for (auto& item : node->dynamic_nodes) visit(item.node);
+        }
+      }
+
+      /**
+       * Counts as a change of the routes, whatever the caller does with the root.
+       */
+      RouterNode<T>& get_root() noexcept {
+        version_++;
+        return root_;
+      }
+
+      /**
+       * Goes up every time a route is added (see Router::version()), caches like CachedRouter rely on it.
+       */
+      uint64_t version() const noexcept override { return version_.load(std::memory_order_acquire); }
+
+      /**
+       * Compiles the routes added so far into an immutable FrozenRouter (see frozen_router.h) which resolves paths the
+       * same way, only faster. Meant for routers that are done changing by the time the server starts. The handlers and
+       * matchers are shared with this router, the nodes are not.
+       */
+      FrozenRouter<T> freeze() const;
+
+      /**
+       * Writes the routes added so far to a snapshot file FrozenRouter::load() maps back into a frozen router, for
+       * servers that would rather not add their routes one by one on every start. Matchers are saved as the segments
+       * they were made for, so routes with dynamic segments need to have been added by path; handlers are saved under
+       * the names handler_ids gives them, loading looks them up by those names.
+       */
+      void save(
+        const std::string& file, const std::function<std::string(const std::shared_ptr<T>&)>& handler_ids
+      ) const;
 
     private:
+      friend class FrozenRouter<T>;  // rebuilds matchers from their segments when loading snapshots.
+
       utility::registry<RouteMatcherBuilder> matcher_factory_registry_;  // a registry for factories that make matchers.
+      std::unordered_map<std::string_view, std::shared_ptr<RouteMatcher>> matchers_;  // keyed by their segments.
+      std::forward_list<std::string> matcher_specs_;  // the segments matchers_ is keyed by.
       RouterNode<T> root_;
+      std::atomic<uint64_t> version_{0};
+      bool adaptive_ = false;
 
-      bool is_static_route(const std::string &route) {
-        std::regex static_node_matcher{R"(^[\w\d]*$)", std::regex_constants::ECMAScript | std::regex_constants::icase};
-        return std::regex_match(route, static_node_matcher);
+      /**
+       * Static segments are made of letters, digits and the other characters URLs leave unreserved: "-", ".", "_", "~".
+       */
+      static bool is_static_route(std::string_view route) noexcept {
+        return std::all_of(begin(route), end(route), [](char character) {
+          return std::isalnum(static_cast<unsigned char>(character)) || character == '-' || character == '.' ||
+                 character == '_' || character == '~';
+        });
       }
 
-      bool parse_dynamic_route(const std::string &route, std::string &matcher_name, std::vector<std::string> &args) {
-        std::regex dynamic_node_matcher{R"(^<([\w\d]*)((?::[\d\w!@#$%^&*()~\\,-]*)*)>$)", std::regex_constants::ECMAScript};
-        std::smatch match_result;
-        if (std::regex_match(route, match_result, dynamic_node_matcher)) {
-          matcher_name = match_result.str(1);
-          utility::string_partitioner::for_each(match_result.str(2), [&args](auto arg) {
-            args.push_back(std::move(arg));
-          }, ':');
-          return true;
+      /**
+       * Splits a dynamic segment, e.g. "<re:(\d+)-(\d+):start:end>", into the alias of its matcher and its arguments.
+       * Aliases are made of letters, digits and underscores, arguments of any printable character but ":<>".
+       * @return false if the segment is not a dynamic one.
+       */
+      static bool parse_dynamic_route(std::string_view route, std::string& matcher_name, RouteMatcherArgs& args) {
+        if (route.size() < 2 || route.front() != '<' || route.back() != '>') return false;
+        auto body = route.substr(1, route.size() - 2);
+        auto name = body.substr(0, body.find(':'));
+        if (!std::all_of(begin(name), end(name), [](char character) {
+          return std::isalnum(static_cast<unsigned char>(character)) || character == '_';
+        })) {
+          return false;
+        }
+        auto rest = body.substr(name.size());
+        if (!std::all_of(begin(rest), end(rest), [](char character) {
+          return std::isgraph(static_cast<unsigned char>(character)) && character != '<' && character != '>';
+        })) {
+          return false;
         }
-        return false;
+        matcher_name = name;
+        utility::string_partitioner it{rest, ':'};  // empty arguments are skipped.
+        std::string_view arg;
+        while (it.next(arg)) args.emplace_back(arg);
+        return true;
       }
 
-      RouterNode<T>* mk_route(const std::string &path) {
+      /**
+       * Matchers are immutable, identical segments share one no matter the node they're in. Aliases can't be replaced
+       * once registered, so the matchers they built stay valid.
+       */
+      std::shared_ptr<RouteMatcher> get_matcher(std::string_view route) {
+        auto it = matchers_.find(route);
+        if (it != end(matchers_)) return it->second;
+        std::string matcher_name;
+        RouteMatcherArgs args;
+        if (!parse_dynamic_route(route, matcher_name, args)) {
+          throw std::invalid_argument{"The provided path is not valid: " + std::string{route}};
+        }
+        auto matcher = matcher_factory_registry_[matcher_name](std::move(args));
+        matchers_.emplace(matcher_specs_.emplace_front(route), matcher);
+        return matcher;
+      }
+
+      void add_route(const route_entry& entry, std::unordered_set<RouterNode<T>*>* deferred) {
+        auto node = this->mk_route(entry.path, deferred);
+        if (entry.method) {
+          node->set_handler(*entry.method, entry.handler);
+        } else {
+          node->handler = entry.handler;
+        }
+        if (!entry.name.empty()) node->name = entry.name;
+      }
+
+      /**
+       * @param deferred Collects the nodes that got new dynamic children without compiling them, if given.
+       */
+      RouterNode<T>* mk_route(std::string_view path, std::unordered_set<RouterNode<T>*>* deferred=nullptr) {
         auto cursor = &this->root_;
-        utility::string_partitioner::for_each(path, [&](auto& route) {
+        bool consumed = false;  // nothing is left of the path to resolve after a matcher that consumes the remainder.
+        utility::string_partitioner it{path};
+        std::string_view route;
+        while (it.next(route)) {
+          if (consumed) {
+            throw std::invalid_argument{"Nothing can follow a matcher of the rest of the path: " + std::string{path}};
+          }
           // If route is a static string.
           if (is_static_route(route)) {
-            if (auto static_node = cursor->get_static_node(route))
+            if (auto static_node = cursor->get_static_node(route)) {
               cursor = static_node.get();
-            else {
+            } else {
               auto new_node = new RouterNode<T>();
+              new_node->set_adaptive(adaptive_);
               cursor->add_node(route, std::shared_ptr<RouterNode<T>>(new_node));
               cursor = new_node;
             }
-            return;
+            continue;
           }
 
-          // If route is dynamic and needs to create a matcher.
-          std::string matcher_name;
-          RouteMatcherArgs args;
-          if (parse_dynamic_route(route, matcher_name, args)) {  // try to parse the route as a dynamic route format.
-            auto hash = std::hash<std::string>()(route);  // make a hash of the route.
-            if (auto dynamic_node = cursor->get_dynamic_node(hash))
-              cursor = dynamic_node.get();
-            else {
-              auto matcher = matcher_factory_registry_[matcher_name](std::move(args));
-              auto new_node = new RouterNode<T>();
-              cursor->add_node(hash, std::move(matcher), std::shared_ptr<RouterNode<T>>(new_node));
-              cursor = new_node;
-            }
-            return;
+          // If route is dynamic and needs a matcher, the same as std::hash<std::string> would give.
+          auto hash = std::hash<std::string_view>()(route);
+          if (auto dynamic_node = cursor->get_dynamic_node(hash)) {
+            consumed = std::any_of(begin(cursor->dynamic_nodes), end(cursor->dynamic_nodes), [&hash](auto& item) {
+              return item.hash == hash && item.consumes_remainder;
+            });
+            cursor = dynamic_node.get();
           } else {
-            // route is invalid format. raise exception
-            throw std::invalid_argument{"The provided path is not valid: " + route};
+            auto matcher = this->get_matcher(route);
+            consumed = matcher->consumes_remainder();
+            auto new_node = new RouterNode<T>();
+            new_node->set_adaptive(adaptive_);
+            cursor->add_node(hash, std::move(matcher), std::shared_ptr<RouterNode<T>>(new_node), !deferred);
+            if (deferred) deferred->insert(cursor);
+            cursor = new_node;
           }
-        });
+        }
         return cursor;
       }
 
-      const RouterNode<T> * resolve(const RouterNode<T> *&head, const std::string &route, RouteParams &params) const {
-        // First try the fast hash map approach for static static_nodes.
-        const auto& map_it = head->static_nodes.find(route);
-        if (map_it != end(head->static_nodes)) {
-          return map_it->second.get();
-        }
+      const RouterNode<T>* find_node(std::string_view path, RouteParams& params) const {
+        const RouterNode<T>* head = &this->root_;
+        utility::string_partitioner it{path};
+        std::string_view route;
+        while (it.next(route)) {
+          // First try the fast hash map approach for static static_nodes.
+          const auto& map_it = head->static_nodes.find(route);
+          if (map_it != end(head->static_nodes)) {
+            head = map_it->second.get();
+            continue;
+          }
 
-        // Now go through all matchers and try to match.
-        const auto& matcher_it = std::find_if(begin(head->dynamic_nodes), end(head->dynamic_nodes), [&](auto& pair) {
-          return pair.matcher->match(route, params);
-        });
-        if (matcher_it != end(head->dynamic_nodes)) {
-          return matcher_it->node.get();
+          // Now go through all matchers and try to match.
+          auto remainder = path.substr(static_cast<size_t>(route.data() - path.data()));
+          auto dynamic_node = head->match_dynamic_node(route, remainder, params);
+          if (!dynamic_node) return nullptr;
+          head = dynamic_node->node.get();
+          if (dynamic_node->consumes_remainder) break;
         }
-
-        // Otherwise, just return nothing.
-        return nullptr;
+        return head;
       }
     };
   }
@@ -0,0 +1,191 @@
+//
+// Created by Peyman Mortazavi on 2019-06-02.
+//
+
+#ifndef SUSPIRIA_HOST_ROUTER_H
+#define SUSPIRIA_HOST_ROUTER_H
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "router.h"
+
+namespace suspiria {
+
+  namespace networking {
+
+    /**
+     * Picks the router of a request by its Host header, for servers that serve many hostnames: each host gets a router
+     * of its own in front of which this one sits. Hosts are either exact, e.g. "api.example.com", or wildcards that
+     * match every subdomain of a domain however deep, e.g. "*.example.com" for "a.example.com" and "a.b.example.com"
+     * but not "example.com" itself. An exact host wins over a wildcard and a longer wildcard over a shorter one, hosts
+     * matching nothing go to the default router if there is one.
+     *
+     * Hosts are compared without their case, their port or a trailing dot. Finding the router of a host reads it once,
+     * from its end: the hash of every suffix that follows a dot is at hand on the way, and each of them is a probe
+     * into an open addressing table, so nothing gets copied or lowercased and the number of hosts doesn't matter.
+     *
+     * Like the routers it holds, hosts can't be added while requests are being routed; swap the whole HostRouter, or
+     * put a RouterHolder behind a host, to change them while serving.
+     */
+    template<class T>
+    class HostRouter {
+    public:
+      /**
+       * Routes the host to the router, replacing the router it had if any.
+       * @param host either a hostname or "*." followed by one, an optional port is ignored.
+       */
+      void add_host(std::string_view host, std::shared_ptr<const Router<T>> router) {
+        if (!router) throw std::invalid_argument{"can't route a host to an empty router"};
+        bool wildcard = host.substr(0, 2) == "*.";
+        auto name = normalize(wildcard ? host.substr(2) : host);
+        if (name.empty() || name.find('*') != std::string_view::npos) {
+          throw std::invalid_argument{"The provided host is not valid: " + std::string{host}};
+        }
+
+        std::string key;
+        for (auto character : name) key += lower(character);
+        auto key_hash = hash(key, wildcard);
+        if (auto existing = this->find_entry(key_hash, key, wildcard)) {
+          existing->router = std::move(router);
+          return;
+        }
+        entries_.push_back({key_hash, std::move(key), wildcard, std::move(router)});
+        wildcards_ = wildcards_ || wildcard;
+        if (entries_.size() * 2 > slots_.size()) {
+          this->rehash();
+        } else {
+          this->insert(entries_.size() - 1);
+        }
+      }
+
+      void set_default(std::shared_ptr<const Router<T>> router) { default_ = std::move(router); }
+
+      /**
+       * @return The router of the host, e.g. the value of a Host header, nullptr if there's none and no default.
+       */
+      const Router<T>* find(std::string_view host) const noexcept {
+        host = normalize(host);
+        const Router<T>* wildcard = nullptr;
+        auto value = offset_basis;  // hashes the host from its end, every suffix gets its hash on the way.
+        for (auto index = host.size(); index-- > 0;) {
+          if (host[index] == '.' && wildcards_ && index > 0 && index + 1 < host.size()) {
+            // suffixes come longest last, so the most specific wildcard is the one that sticks.
+            if (auto match = this->find_entry(value, host.substr(index + 1), true)) wildcard = match->router.get();
+          }
+          value = step(value, host[index]);
+        }
+        if (auto match = this->find_entry(value ^ exact_tag, host, false)) return match->router.get();
+        return wildcard ? wildcard : default_.get();
+      }
+
+      ResolveResult<T> resolve(std::string_view host, std::string_view path) const {
+        auto router = this->find(host);
+        return router ? router->resolve(path) : ResolveResult<T>{};
+      }
+
+      ResolveResult<T> resolve(std::string_view host, HttpMethod method, std::string_view path) const {
+        auto router = this->find(host);
+        return router ? router->resolve(method, path) : ResolveResult<T>{};
+      }
+
+      size_t size() const noexcept { return entries_.size(); }
+
+    private:
+      struct entry {
+        uint64_t hash;
+        std::string key;  // lowercase, without the "*." of wildcards.
+        bool wildcard;
+        std::shared_ptr<const Router<T>> router;
+      };
+
+      struct slot {
+        uint64_t hash = 0;
+        int32_t entry = -1;
+      };
+
+      static constexpr uint64_t offset_basis = 14695981039346656037ull;
+      static constexpr uint64_t exact_tag = 0x9e3779b97f4a7c15ull;  // flips the hashes of exact hosts, see hash().
+
+      static char lower(char character) noexcept {
+        return character >= 'A' && character <= 'Z' ? static_cast<char>(character - 'A' + 'a') : character;
+      }
+
+      static uint64_t step(uint64_t value, char character) noexcept {
+        return (value ^ static_cast<unsigned char>(lower(character))) * 1099511628211ull;
+      }
+
+      /**
+       * FNV-1a of a host read backwards, the way find() reads them. Exact hosts get theirs flipped by a constant, so
+       * that a host and the wildcard for its subdomains hash apart.
+       */
+      static uint64_t hash(std::string_view host, bool wildcard) noexcept {
+        auto value = offset_basis;
+        for (auto index = host.size(); index-- > 0;) value = step(value, host[index]);
+        return wildcard ? value : value ^ exact_tag;
+      }
+
+      /**
+       * Drops the port and a trailing dot, e.g. "Example.com.:8080" becomes "Example.com". IPv6 addresses keep their
+       * brackets.
+       */
+      static std::string_view normalize(std::string_view host) noexcept {
+        auto end = host.find(':', host.empty() || host.front() != '[' ? 0 : host.find(']'));
+        host = host.substr(0, end);
+        if (!host.empty() && host.back() == '.') host.remove_suffix(1);
+        return host;
+      }
+
+      static bool equals(std::string_view key, std::string_view host) noexcept {
+        if (key.size() != host.size()) return false;
+        for (size_t index = 0; index < key.size(); index++) {
+          if (key[index] != lower(host[index])) return false;
+        }
+        return true;
+      }
+
+      const entry* find_entry(uint64_t value, std::string_view host, bool wildcard) const noexcept {
+        if (slots_.empty()) return nullptr;
+        for (auto index = value & (slots_.size() - 1);; index = (index + 1) & (slots_.size() - 1)) {
+          auto& current = slots_[index];
+          if (current.entry < 0) return nullptr;
+          auto& item = entries_[current.entry];
+          if (current.hash == value && item.wildcard == wildcard && equals(item.key, host)) return &item;
+        }
+      }
+
+      entry* find_entry(uint64_t value, std::string_view host, bool wildcard) noexcept {
+        return const_cast<entry*>(static_cast<const HostRouter*>(this)->find_entry(value, host, wildcard));
+      }
+
+      /**
+       * Lays the entries out in a table at most half full, which keeps the probe sequences short.
+       */
+      void rehash() {
+        size_t capacity = 8;
+        while (capacity < entries_.size() * 2) capacity <<= 1;
+        slots_.assign(capacity, slot{});
+        for (size_t index = 0; index < entries_.size(); index++) this->insert(index);
+      }
+
+      void insert(size_t index) noexcept {
+        auto position = entries_[index].hash & (slots_.size() - 1);
+        while (slots_[position].entry >= 0) position = (position + 1) & (slots_.size() - 1);
+        slots_[position] = {entries_[index].hash, static_cast<int32_t>(index)};
+      }
+
+      std::vector<entry> entries_;
+      std::vector<slot> slots_;
+      std::shared_ptr<const Router<T>> default_;
+      bool wildcards_ = false;  // skips the probes for suffixes when there's no wildcard to find.
+    };
+
+  }
+
+}
+
+#endif //SUSPIRIA_HOST_ROUTER_H
@@ -0,0 +1,146 @@
+//
+// Created by Peyman Mortazavi on 2019-05-22.
+//
+
+#ifndef SUSPIRIA_PATH_REGEX_H
+#define SUSPIRIA_PATH_REGEX_H
+
+#include <bitset>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace suspiria {
+
+  namespace networking {
+
+    /**
+     * A small regular expression engine for matching path segments in linear time, std::regex backtracks and takes its
+     * time doing so. It supports the part of the ECMAScript syntax routes need: literals and escapes, ".", classes
+     * (e.g. [^a-z\d]), \d \w \s and their negations, capturing and non capturing groups, alternation and the greedy
+     * and lazy *, +, ?, {n}, {n,} and {n,m} quantifiers, plus ^ and $ at the very ends of the pattern. Everything else
+     * (back references, assertions, ...) is left to std::regex, see compile().
+     *
+     * Patterns get compiled into an NFA program and, as long as it stays reasonably small, into a DFA as well. Whether
+     * the whole text matches is decided by walking the DFA, one table lookup per character. The groups are only found
+     * for texts that match, by running the program on a bounded backtracker (or a Pike VM for long texts) which gives
+     * them the same values std::regex would.
+     */
+    class PathRegex {
+    public:
+      static constexpr uint32_t no_position = UINT32_MAX;
+
+      /**
+       * @return The compiled pattern or nothing if the pattern uses syntax this engine doesn't support or is invalid.
+       */
+      static std::optional<PathRegex> compile(std::string_view pattern);
+
+      size_t group_count() const noexcept { return group_count_; }
+
+      /**
+       * Tells whether the whole text matches the pattern.
+       */
+      bool match(std::string_view text) const noexcept;
+
+      /**
+       * Tells whether the whole text matches the pattern and if it does, calls on_group(index, value) for every
+       * capturing group in order. Groups that took no part in the match get an empty value.
+       */
+      template<typename Callback>
+      bool match(std::string_view text, Callback&& on_group) const {
+        if (!this->match(text)) return false;
+        if (group_count_ == 0) return true;
+        auto captures = this->find_groups(text);
+        for (size_t index = 0; index < group_count_; index++) {
+          auto start = captures[index * 2], end = captures[index * 2 + 1];
+          if (start == no_position || end == no_position) {
+            on_group(index, std::string_view{});
+          } else {
+            on_group(index, text.substr(start, end - start));
+          }
+        }
+        return true;
+      }
+
+      /**
+       * Tells whether no text matches both patterns. Patterns too complex to have a DFA are assumed to overlap.
+       */
+      bool disjoint(const PathRegex& other) const;
+
+      enum class opcode : uint8_t { characters, split, jump, save, match };
+
+      struct instruction {
+        opcode op;
+        uint32_t x = 0;  // the character set, the jump target, the preferred branch or the capture slot.
+        uint32_t y = 0;  // the other branch of a split.
+      };
+
+    private:
+      friend class PathRegexSet;
+
+      PathRegex() = default;
+
+      void build_dfa();
+      bool run_dfa(std::string_view text) const noexcept;
+      bool backtrack(std::string_view text, uint32_t* captures) const;
+      bool run_program(std::string_view text, uint32_t* captures) const;
+      const uint32_t* find_groups(std::string_view text) const;
+
+      std::vector<instruction> program_;
+      std::vector<std::bitset<256>> sets_;
+      size_t group_count_ = 0;
+
+      // the DFA, left empty when the pattern would need too many states.
+      uint8_t classes_[256] = {};  // characters that no set tells apart share a class and a column in the table.
+      size_t class_count_ = 0;
+      std::vector<int32_t> transitions_;  // state * class_count_ + class, -1 is the dead state.
+      std::vector<bool> accepting_;
+    };
+
+    /**
+     * Many patterns compiled into a single DFA, which finds every one of them that matches a text in one pass over it.
+     * Members without a pattern stand for patterns that match anything.
+     */
+    class PathRegexSet {
+    public:
+      /**
+       * Indices of the members that match, in increasing order.
+       */
+      struct matches {
+        const uint32_t* first;
+        const uint32_t* last;
+
+        const uint32_t* begin() const noexcept { return first; }
+        const uint32_t* end() const noexcept { return last; }
+        bool empty() const noexcept { return first == last; }
+      };
+
+      /**
+       * @param patterns The members of the set, nullptr for the ones that match anything.
+       * @return The compiled set or nothing if the combined DFA would be too big.
+       */
+      static std::optional<PathRegexSet> compile(const std::vector<const PathRegex*>& patterns);
+
+      size_t size() const noexcept { return size_; }
+
+      matches match(std::string_view text) const noexcept;
+
+    private:
+      PathRegexSet() = default;
+
+      size_t size_ = 0;
+      uint8_t classes_[256] = {};
+      size_t class_count_ = 0;
+      std::vector<int32_t> transitions_;  // same layout as in PathRegex.
+      std::vector<std::pair<uint32_t, uint32_t>> states_;  // the range of matches_ every state accepts.
+      std::pair<uint32_t, uint32_t> dead_;
+      std::vector<uint32_t> matches_;
+    };
+
+  }
+
+}
+
+#endif //SUSPIRIA_PATH_REGEX_H
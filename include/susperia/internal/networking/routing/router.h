@@ -8,34 +8,158 @@
 #define SUSPIRIA_ROUTER_H
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <unordered_map>
 #include <memory>
 #include <regex>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <functional>
+#include <iterator>
+#include <optional>
+#include <variant>
 
 #include <susperia/internal/utility.h>
+#include <susperia/internal/networking/http_method.h>
 
 
 namespace suspiria {
 
   namespace networking {
 
-    typedef std::unordered_map<std::string, std::string> RouteParams;
+    typedef std::array<uint8_t, 16> Uuid;  // the 16 bytes of a uuid, in the order they are written in.
 
+    /**
+     * The parameters captured while resolving a path, in the order they were captured. Most routes capture one or two
+     * of them, so the first few live inline in the object and resolving such a route allocates nothing. Names and
+     * values are views: names point into the router's matchers and values into the resolved path, so the parameters
+     * are only valid as long as both of them are around (e.g. while the request is being handled).
+     */
+    class RouteParams {
+    public:
+      /**
+       * The value as parsed by a typed matcher (e.g. <int:id>), so handlers get to skip parsing it again.
+       */
+      typedef std::variant<std::monostate, int64_t, uint64_t, Uuid> typed_value;
+
+      struct param {
+        std::string_view name;
+        std::string_view value;
+        typed_value typed;
+      };
+      typedef const param* const_iterator;
+
+      static constexpr size_t inline_capacity = 4;
+
+      const param* find(std::string_view name) const noexcept {
+        auto it = std::find_if(begin(), end(), [&name](auto& item) { return item.name == name; });
+        return it != end() ? it : nullptr;
+      }
+      bool contains(std::string_view name) const noexcept { return this->find(name) != nullptr; }
+
+      std::string_view get(std::string_view name, std::string_view fallback={}) const noexcept {
+        auto item = this->find(name);
+        return item ? item->value : fallback;
+      }
+      std::string_view operator[](std::string_view name) const noexcept { return this->get(name); }
+
+      /**
+       * Returns the parsed value of a parameter, or nothing if it is missing or was not parsed as a T by its matcher.
+       * For instance get_as<int64_t>("id") for <int:id> or get_as<Uuid>("id") for <uuid:id>.
+       */
+      template<typename T>
+      std::optional<T> get_as(std::string_view name) const noexcept {
+        auto item = this->find(name);
+        if (!item) return std::nullopt;
+        if (auto value = std::get_if<T>(&item->typed)) return *value;
+        return std::nullopt;
+      }
+
+      /**
+       * Sets the value of a parameter, replacing the value it was given earlier in the path if there is one.
+       */
+      void set(std::string_view name, std::string_view value, const typed_value& typed={}) {
+        auto data = overflow_.empty() ? inline_ : overflow_.data();
+        auto it = std::find_if(data, data + size_, [&name](auto& item) { return item.name == name; });
+        if (it != data + size_) {
+          it->value = value;
+          it->typed = typed;
+        } else if (overflow_.empty() && size_ < inline_capacity) {
+          inline_[size_++] = param{name, value, typed};
+        } else {
+          if (overflow_.empty()) overflow_.assign(std::begin(inline_), std::begin(inline_) + size_);
+          overflow_.push_back(param{name, value, typed});
+          size_++;
+        }
+      }
+
+      void clear() noexcept {
+        overflow_.clear();
+        size_ = 0;
+      }
+
+      size_t size() const noexcept { return size_; }
+      bool empty() const noexcept { return size_ == 0; }
+      const_iterator begin() const noexcept { return overflow_.empty() ? inline_ : overflow_.data(); }
+      const_iterator end() const noexcept { return this->begin() + size_; }
+
+      bool operator==(const RouteParams& other) const noexcept {
+        return std::equal(begin(), end(), other.begin(), other.end(), [](auto& first, auto& second) {
+          return first.name == second.name && first.value == second.value;
+        });
+      }
+      bool operator!=(const RouteParams& other) const noexcept { return !(*this == other); }
+
+    private:
+      param inline_[inline_capacity];
+      std::vector<param> overflow_;  // holds all of the params once they outgrow the inline ones.
+      size_t size_ = 0;
+    };
+
+    /**
+     * Whether a handler was found, along with the methods the path has handlers for. A path that exists but has no
+     * handler for the method asked for (405) has some methods allowed, one that doesn't exist (404) has none. The
+     * allowed methods are also what an OPTIONS request without a handler of its own should reply with.
+     */
     template<class T>
     struct ResolveResult {
       bool matched = false;
       std::shared_ptr<T> handler = nullptr;
       RouteParams params;
+      HttpMethods allowed;
+
+      bool method_not_allowed() const noexcept { return !matched && !allowed.empty(); }
     };
 
     template<class T>
     class Router {
     public:
       virtual ~Router() = default;
-      virtual ResolveResult<T> resolve(const std::string& path) const = 0;
+
+      /**
+       * Resolves the handler registered for any method.
+       */
+      virtual ResolveResult<T> resolve(std::string_view path) const = 0;
+
+      /**
+       * Resolves the handler registered for the method, or the one registered for any method if there's none.
+       */
+      virtual ResolveResult<T> resolve(HttpMethod method, std::string_view path) const = 0;
+
+      /**
+       * Changes whenever the routes change, results resolved at different versions may differ. Routers that never
+       * change stay at zero.
+       */
+      virtual uint64_t version() const noexcept { return 0; }
+
+      /**
+       * The router resolving paths for this one right now, for routers that swap the table behind them (see
+       * RouterHolder). Parameter names point into it, holding on to it keeps them valid. Routers that resolve paths
+       * themselves have none.
+       */
+      virtual std::shared_ptr<const Router<T>> snapshot() const { return nullptr; }
     };
 
   }
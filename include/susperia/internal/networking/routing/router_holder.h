@@ -0,0 +1,117 @@
+//
+// Created by Peyman Mortazavi on 2019-05-28.
+//
+
+#ifndef SUSPIRIA_ROUTER_HOLDER_H
+#define SUSPIRIA_ROUTER_HOLDER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "router.h"
+
+namespace suspiria {
+
+  namespace networking {
+
+    /**
+     * Holds the routing table of a running server and swaps it for a new one atomically, RCU style. Routers can't be
+     * changed while paths are being resolved on them, so a new table gets built off to the side (e.g. a GraphRouter,
+     * frozen or not) and published as a whole; requests already in flight keep resolving on the table they started
+     * with, new ones get the new table.
+     *
+     * Readers never lock: every thread keeps the snapshot it last used along with its version and only looks at the
+     * shared pointer again when the version moves, which costs a single atomic load the rest of the time. A snapshot is
+     * reclaimed when the last one holding it lets go of it, that is every request that took it with snapshot() and
+     * every thread that resolved on it, threads let go of theirs the next time they resolve after a publish.
+     *
+     * Published routers must not change afterwards, the version of the holder only moves with publish().
+     */
+    template<class T>
+    class RouterHolder : public Router<T> {
+    public:
+      explicit RouterHolder(std::shared_ptr<const Router<T>> router) : id_(next_id()) {
+        this->publish(std::move(router));
+      }
+      RouterHolder(const RouterHolder&) = delete;
+
+      /**
+       * Makes the router the one all following lookups resolve on.
+       */
+      void publish(std::shared_ptr<const Router<T>> router) {
+        if (!router) throw std::invalid_argument{"can't publish an empty router"};
+        std::lock_guard<std::mutex> lock{publish_mutex_};  // keeps the versions in the order of the routers.
+        std::atomic_store_explicit(&current_, std::move(router), std::memory_order_release);
+        version_.fetch_add(1, std::memory_order_release);
+      }
+
+      /**
+       * The current router, for requests that need a consistent view for their whole life: the parameters of a result
+       * point into the router that resolved it, holding on to the snapshot keeps them valid across a publish.
+       */
+      std::shared_ptr<const Router<T>> snapshot() const override { return this->cached().snapshot; }
+
+      ResolveResult<T> resolve(std::string_view path) const override {
+        return this->cached().snapshot->resolve(path);
+      }
+
+      ResolveResult<T> resolve(HttpMethod method, std::string_view path) const override {
+        return this->cached().snapshot->resolve(method, path);
+      }
+
+      uint64_t version() const noexcept override { return version_.load(std::memory_order_acquire); }
+
+    private:
+      struct cache_entry {
+        uint64_t holder;
+        uint64_t version;
+        std::weak_ptr<const void> alive;  // expires with the holder, so threads can drop the entries of dead ones.
+        std::shared_ptr<const Router<T>> snapshot;
+      };
+
+      static uint64_t next_id() noexcept {
+        static std::atomic<uint64_t> ids{0};
+        return ids.fetch_add(1, std::memory_order_relaxed) + 1;
+      }
+
+      const cache_entry& cached() const {
+        thread_local std::vector<cache_entry> entries;
+        auto version = version_.load(std::memory_order_acquire);
+        for (auto& entry : entries) {
+          if (entry.holder != id_) continue;
+          if (entry.version != version) this->refresh(entry, version);
+          return entry;
+        }
+
+        entries.erase(std::remove_if(begin(entries), end(entries), [](auto& entry) {
+          return entry.alive.expired();
+        }), end(entries));
+        auto& entry = entries.emplace_back(cache_entry{id_, 0, alive_, nullptr});
+        this->refresh(entry, version);
+        return entry;
+      }
+
+      void refresh(cache_entry& entry, uint64_t version) const {
+        // a snapshot newer than the version is fine, it just gets loaded again next time.
+        entry.snapshot = std::atomic_load_explicit(&current_, std::memory_order_acquire);
+        entry.version = version;
+      }
+
+      uint64_t id_;
+      std::shared_ptr<const void> alive_ = std::make_shared<char>();
+      std::shared_ptr<const Router<T>> current_;
+      std::atomic<uint64_t> version_{0};
+      std::mutex publish_mutex_;
+    };
+
+  }
+
+}
+
+#endif //SUSPIRIA_ROUTER_HOLDER_H
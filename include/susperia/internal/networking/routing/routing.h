@@ -7,5 +7,10 @@
 
 #include "router.h"
 #include "graph_router.h"
+#include "frozen_router.h"
+#include "cached_router.h"
+#include "router_holder.h"
+#include "static_router.h"
+#include "host_router.h"
 
 #endif //SUSPIRIA_ROUTING_H
@@ -0,0 +1,412 @@
+//
+// Created by Peyman Mortazavi on 2019-05-30.
+//
+
+#ifndef SUSPIRIA_STATIC_ROUTER_H
+#define SUSPIRIA_STATIC_ROUTER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "graph_router.h"
+#include "router.h"
+#include "susperia/internal/utility.h"
+
+namespace suspiria {
+
+  namespace networking {
+
+    /**
+     * A route known at compile time, see StaticRouteTable. The handler is kept by value, so it has to be a literal type
+     * for the table to be built at compile time, e.g. a function pointer.
+     */
+    template<class T>
+    struct StaticRoute {
+      constexpr StaticRoute(std::string_view path, T handler) : path(path), handler(handler) {}
+      constexpr StaticRoute(HttpMethod method, std::string_view path, T handler)
+        : path(path), handler(handler), method(method), any_method(false) {}
+
+      std::string_view path;
+      T handler;
+      HttpMethod method = GET;
+      bool any_method = true;  // handles the methods that have no route of their own, like RouterNode::handler.
+    };
+
+    /**
+     * What a segment of a static route matches. Typed segments are parsed by the validators of the matchers with the
+     * same aliases in GraphRouter, e.g. <int:id> by IntValidator.
+     */
+    enum class StaticSegmentKind : uint8_t { text, variable, integer, unsigned_integer, uuid, slug, hex, path };
+
+    struct StaticSegment {
+      StaticSegmentKind kind = StaticSegmentKind::text;
+      std::string_view text;  // the segment itself for text, the name of the parameter for the other kinds.
+    };
+
+    /**
+     * Routes parsed and ordered at compile time, for the ones known before the program even starts. The same formats
+     * as GraphRouter::add_route() are understood, with the typed matchers ("", int, uint, uuid, slug, hex and path) but
+     * not the regular expressions, those and the routes added at runtime are left to a router to fall back on (see
+     * StaticRouter). Malformed routes fail to compile.
+     *
+     * Resolving a path splits it once and goes over the routes with as many segments, which are worked out at compile
+     * time for every number of segments. Only their text segments get compared, lengths first, and only then do their
+     * typed segments get parsed, calling the validators directly. Routes are ranked as a whole: at the first segment
+     * where two routes differ, text comes before a typed segment and a typed one before <path:...>, routes that only
+     * differ in their typed segments stay in the order they were declared in. The first route that matches the whole
+     * path wins.
+     *
+     * That is not always the route a GraphRouter with the same routes finds. A graph settles every segment on its own,
+     * going down the first child that matches it, and fails the whole path if that child fails further down; the table
+     * moves on to the next route instead. With "/u/<:v>/<int:a>" and "/u/<int:i>/b", a graph takes "/u/1/b" down
+     * <:v> and finds nothing, the table ranks "/u/<int:i>/b" first for its text and finds it.
+     *
+     * Routes of the same path with different methods resolve together, the same as the methods of a RouterNode.
+     */
+    template<class T, size_t N, size_t MaxSegments>
+    class StaticRouteTable {
+    public:
+      constexpr explicit StaticRouteTable(const StaticRoute<T> (&routes)[N])
+        : StaticRouteTable(routes, std::make_index_sequence<N>{}) {}
+
+      /**
+       * @return The handler of the route of the path for the method, or the one for any method if it has none. When it
+       * returns nullptr allowed tells a path that exists (the methods it has routes for) from one that doesn't (none).
+       */
+      const T* find(HttpMethod method, std::string_view path, RouteParams& params, HttpMethods& allowed) const {
+        auto route = this->find_route(method, path, params, allowed);
+        return route >= 0 ? &routes_[route].handler : nullptr;
+      }
+
+      /**
+       * Same as find(method, ...) for the handler of any method.
+       */
+      const T* find(std::string_view path, RouteParams& params, HttpMethods& allowed) const {
+        auto route = this->find_route(path, params, allowed);
+        return route >= 0 ? &routes_[route].handler : nullptr;
+      }
+
+      /**
+       * @return The index of the route found as find(method, ...) does, -1 for none.
+       */
+      int32_t find_route(HttpMethod method, std::string_view path, RouteParams& params, HttpMethods& allowed) const {
+        path_segments segments;
+        auto found = this->find_pattern(path, segments);
+        if (!found) return -1;
+        allowed = found->allowed;
+        auto index = method_index(method);
+        auto route = index >= 0 && found->methods[index] >= 0 ? found->methods[index] : found->any_method;
+        if (route >= 0) set_params(*found, path, segments, params);
+        return route;
+      }
+
+      int32_t find_route(std::string_view path, RouteParams& params, HttpMethods& allowed) const {
+        path_segments segments;
+        auto found = this->find_pattern(path, segments);
+        if (!found) return -1;
+        allowed = found->allowed;
+        if (found->any_method >= 0) set_params(*found, path, segments, params);
+        return found->any_method;
+      }
+
+      constexpr size_t size() const noexcept { return N; }
+      constexpr const StaticRoute<T>& operator[](size_t index) const { return routes_[index]; }
+
+    private:
+      /**
+       * The routes of a single path.
+       */
+      struct pattern {
+        std::array<StaticSegment, MaxSegments> segments{};
+        size_t segment_count = 0;
+        bool consumes_remainder = false;  // ends in <path:...>.
+        std::array<int32_t, http_method_count> methods{};  // indices of routes_, -1 for none.
+        int32_t any_method = -1;
+        HttpMethods allowed;
+      };
+
+      template<size_t... Indices>
+      constexpr StaticRouteTable(const StaticRoute<T> (&routes)[N], std::index_sequence<Indices...>)
+        : routes_{{routes[Indices]...}} {
+        for (size_t index = 0; index < N; index++) this->add(static_cast<int32_t>(index));
+        for (size_t index = 0; index < pattern_count_; index++) {
+          auto& current = patterns_[index];
+          if (current.any_method >= 0) current.allowed = HttpMethods::all();
+        }
+        // a stable insertion sort, routes of the same precedence keep the order they were declared in.
+        for (size_t index = 1; index < pattern_count_; index++) {
+          for (auto position = index; position > 0; position--) {
+            if (!precedes(patterns_[position], patterns_[position - 1])) break;
+            auto swapped = patterns_[position];
+            patterns_[position] = patterns_[position - 1];
+            patterns_[position - 1] = swapped;
+          }
+        }
+        uint32_t size = 0;
+        for (size_t count = 0; count < candidates_begin_.size() - 1; count++) {
+          candidates_begin_[count] = size;
+          for (size_t index = 0; index < pattern_count_; index++) {
+            if (fits(patterns_[index], count)) candidates_[size++] = static_cast<uint32_t>(index);
+          }
+        }
+        candidates_begin_.back() = size;
+      }
+
+      constexpr void add(int32_t route) {
+        auto parsed = parse(routes_[route].path);
+        size_t index = 0;
+        while (index < pattern_count_ && !same_path(patterns_[index], parsed)) index++;
+        if (index == pattern_count_) {
+          for (auto& item : parsed.methods) item = -1;
+          patterns_[pattern_count_++] = parsed;
+        }
+
+        auto& current = patterns_[index];
+        if (routes_[route].any_method) {
+          if (current.any_method >= 0) throw std::invalid_argument{"the route was declared twice"};
+          current.any_method = route;
+          return;
+        }
+        auto method = method_index(routes_[route].method);
+        if (method < 0) throw std::invalid_argument{"routes can't be declared for this method"};
+        if (current.methods[method] >= 0) throw std::invalid_argument{"the route was declared twice"};
+        current.methods[method] = route;
+        current.allowed.add(routes_[route].method);
+      }
+
+      static constexpr pattern parse(std::string_view path) {
+        pattern result;
+        size_t position = 0;
+        while (true) {
+          while (position < path.size() && path[position] == '/') position++;  // empty segments don't count.
+          if (position == path.size()) break;
+          auto end = path.find('/', position);
+          if (end == std::string_view::npos) end = path.size();
+          if (result.consumes_remainder) {
+            throw std::invalid_argument{"nothing can follow a matcher of the rest of the path"};
+          }
+          if (result.segment_count == MaxSegments) throw std::invalid_argument{"the route has too many segments"};
+          auto segment = parse_segment(path.substr(position, end - position));
+          result.segments[result.segment_count++] = segment;
+          result.consumes_remainder = segment.kind == StaticSegmentKind::path;
+          position = end;
+        }
+        return result;
+      }
+
+      static constexpr StaticSegment parse_segment(std::string_view text) {
+        if (text.front() != '<') {
+          if (text.find_first_of("<>") != std::string_view::npos) throw std::invalid_argument{"misplaced < or >"};
+          return StaticSegment{StaticSegmentKind::text, text};
+        }
+        auto colon = text.find(':');
+        if (text.back() != '>' || colon == std::string_view::npos) {
+          throw std::invalid_argument{"dynamic segments look like <matcher:name>"};
+        }
+        auto alias = text.substr(1, colon - 1);
+        auto name = text.substr(colon + 1, text.size() - colon - 2);
+        if (name.empty() || name.find_first_of(":<>") != std::string_view::npos) {
+          throw std::invalid_argument{"dynamic segments look like <matcher:name>"};
+        }
+        constexpr std::pair<std::string_view, StaticSegmentKind> kinds[] = {
+          {"", StaticSegmentKind::variable}, {"int", StaticSegmentKind::integer},
+          {"uint", StaticSegmentKind::unsigned_integer}, {"uuid", StaticSegmentKind::uuid},
+          {"slug", StaticSegmentKind::slug}, {"hex", StaticSegmentKind::hex}, {"path", StaticSegmentKind::path},
+        };
+        for (auto& kind : kinds) {
+          if (kind.first == alias) return StaticSegment{kind.second, name};
+        }
+        throw std::invalid_argument{"unknown matcher, regular expressions are left to the router to fall back on"};
+      }
+
+      static constexpr bool same_path(const pattern& first, const pattern& second) {
+        if (first.segment_count != second.segment_count) return false;
+        for (size_t index = 0; index < first.segment_count; index++) {
+          auto& left = first.segments[index];
+          auto& right = second.segments[index];
+          if (left.kind != right.kind || left.text != right.text) return false;
+        }
+        return true;
+      }
+
+      static constexpr bool fits(const pattern& current, size_t segment_count) {
+        return current.segment_count == segment_count ||
+               (current.consumes_remainder && segment_count > current.segment_count);
+      }
+
+      static constexpr int rank(const StaticSegment& segment) {
+        if (segment.kind == StaticSegmentKind::text) return 0;
+        return segment.kind == StaticSegmentKind::path ? 2 : 1;
+      }
+
+      static constexpr bool precedes(const pattern& first, const pattern& second) {
+        for (size_t index = 0;; index++) {
+          if (index == first.segment_count || index == second.segment_count) {
+            return first.segment_count < second.segment_count;
+          }
+          auto& left = first.segments[index];
+          auto& right = second.segments[index];
+          if (rank(left) != rank(right)) return rank(left) < rank(right);
+          if (rank(left) == 0 && left.text != right.text) return left.text < right.text;
+        }
+      }
+
+      /**
+       * The segments of a path, left uninitialized past the ones it has: clearing them costs more than matching.
+       */
+      struct path_segments {
+        const char* data[MaxSegments];
+        size_t size[MaxSegments];
+        size_t count = 0;  // every segment of the path, only the ones that fit get kept.
+
+        std::string_view operator[](size_t index) const noexcept { return {data[index], size[index]}; }
+      };
+
+      const pattern* find_pattern(std::string_view path, path_segments& segments) const {
+        utility::string_partitioner it{path};
+        std::string_view segment;
+        while (it.next(segment)) {
+          if (segments.count < MaxSegments) {
+            segments.data[segments.count] = segment.data();
+            segments.size[segments.count] = segment.size();
+          }
+          segments.count++;
+        }
+
+        auto bucket = std::min(segments.count, MaxSegments + 1);
+        for (auto index = candidates_begin_[bucket]; index < candidates_begin_[bucket + 1]; index++) {
+          auto& current = patterns_[candidates_[index]];
+          if (matches(current, segments)) return &current;
+        }
+        return nullptr;
+      }
+
+      /**
+       * Parameters are only set once there's a route to hand them to, a path without one for the method keeps none.
+       */
+      static void set_params(
+        const pattern& current, std::string_view path, const path_segments& segments, RouteParams& params
+      ) {
+        for (size_t offset = 0; offset < current.segment_count; offset++) {
+          auto& item = current.segments[offset];
+          if (item.kind == StaticSegmentKind::text) continue;
+          auto value = segments[offset];
+          RouteParams::typed_value typed;
+          if (item.kind == StaticSegmentKind::path) {
+            value = path.substr(static_cast<size_t>(value.data() - path.data()));
+          } else {
+            parse(item.kind, value, typed);  // once more, keeping the value this time.
+          }
+          params.set(item.text, value, typed);
+        }
+      }
+
+      /**
+       * The path has as many segments as the pattern, or more if it ends in <path:...>.
+       */
+      static bool matches(const pattern& current, const path_segments& segments) noexcept {
+        for (size_t index = 0; index < current.segment_count; index++) {
+          auto& item = current.segments[index];
+          if (item.kind == StaticSegmentKind::text && segments[index] != item.text) return false;
+        }
+        RouteParams::typed_value typed;
+        for (size_t index = 0; index < current.segment_count; index++) {
+          if (!parse(current.segments[index].kind, segments[index], typed)) return false;
+        }
+        return true;
+      }
+
+      /**
+       * Calls the validator of typed segments, the other kinds of segments were compared already or take anything.
+       */
+      static bool parse(StaticSegmentKind kind, std::string_view segment, RouteParams::typed_value& typed) noexcept {
+        switch (kind) {
+          case StaticSegmentKind::integer: return IntValidator::parse(segment, typed);
+          case StaticSegmentKind::unsigned_integer: return UintValidator::parse(segment, typed);
+          case StaticSegmentKind::uuid: return UuidValidator::parse(segment, typed);
+          case StaticSegmentKind::slug: return SlugValidator::parse(segment, typed);
+          case StaticSegmentKind::hex: return HexValidator::parse(segment, typed);
+          default: return true;
+        }
+      }
+
+      std::array<StaticRoute<T>, N> routes_;
+      std::array<pattern, N> patterns_{};
+      size_t pattern_count_ = 0;
+      // the patterns that fit paths of every number of segments, in order, the last ones are for paths with more
+      // segments than any route has and only hold the routes ending in <path:...>.
+      std::array<uint32_t, N * (MaxSegments + 2)> candidates_{};
+      std::array<uint32_t, MaxSegments + 3> candidates_begin_{};
+    };
+
+    /**
+     * Builds a table of routes, at compile time when it's assigned to a constexpr variable:
+     *
+     *   constexpr StaticRoute<handler_type> routes[] = {{"/", &home}, {GET, "/users/<int:id>", &get_user}};
+     *   constexpr auto table = make_static_routes(routes);
+     *
+     * @tparam MaxSegments The most segments a route can have.
+     */
+    template<size_t MaxSegments = 8, class T, size_t N>
+    constexpr StaticRouteTable<T, N, MaxSegments> make_static_routes(const StaticRoute<T> (&routes)[N]) {
+      return StaticRouteTable<T, N, MaxSegments>{routes};
+    }
+
+    /**
+     * A Router on top of a StaticRouteTable, for serving it along with routes only known at runtime: paths the table
+     * doesn't have (no route of any method) are resolved by the fallback, e.g. a GraphRouter with the regex routes.
+     * Resolving through the table directly saves the shared_ptr copy results come with, the handlers here are copies
+     * of the ones in the table, made once. The table and the fallback must outlive the router.
+     */
+    template<class T, size_t N, size_t MaxSegments>
+    class StaticRouter : public Router<T> {
+    public:
+      explicit StaticRouter(const StaticRouteTable<T, N, MaxSegments>& table, const Router<T>* fallback=nullptr)
+        : table_(table), fallback_(fallback) {
+        for (size_t index = 0; index < N; index++) handlers_.push_back(std::make_shared<T>(table[index].handler));
+      }
+
+      ResolveResult<T> resolve(std::string_view path) const override {
+        ResolveResult<T> result{};
+        auto route = table_.find_route(path, result.params, result.allowed);
+        if (result.allowed.empty() && fallback_) return fallback_->resolve(path);
+        this->set_handler(route, result);
+        return result;
+      }
+
+      ResolveResult<T> resolve(HttpMethod method, std::string_view path) const override {
+        ResolveResult<T> result{};
+        auto route = table_.find_route(method, path, result.params, result.allowed);
+        if (result.allowed.empty() && fallback_) return fallback_->resolve(method, path);
+        this->set_handler(route, result);
+        return result;
+      }
+
+      /**
+       * The table never changes, the version is the fallback's.
+       */
+      uint64_t version() const noexcept override { return fallback_ ? fallback_->version() : 0; }
+
+    private:
+      void set_handler(int32_t route, ResolveResult<T>& result) const {
+        if (route < 0) return;
+        result.matched = true;
+        result.handler = handlers_[route];
+      }
+
+      const StaticRouteTable<T, N, MaxSegments>& table_;
+      const Router<T>* fallback_;
+      std::vector<std::shared_ptr<T>> handlers_;
+    };
+
+  }
+
+}
+
+#endif //SUSPIRIA_STATIC_ROUTER_H
@@ -0,0 +1,109 @@
+//
+// Created by Peyman Mortazavi on 2019-05-12.
+//
+
+#ifndef SUSPIRIA_SLAB_H
+#define SUSPIRIA_SLAB_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "susperia/internal/utility.h"
+
+
+namespace suspiria::networking {
+
+  /**
+   * Hands out fixed size blocks carved out of large chunks. Freed blocks go on a free list and get reused by the next
+   * allocation, so objects that come and go all the time (e.g. connections) cost no trip to the heap once the slab
+   * has grown to their peak count. The block size is set by the first allocation; anything bigger than that is
+   * passed on to the heap.
+   */
+  class slab {
+  public:
+    static constexpr size_t default_blocks_per_chunk = 256;
+
+    explicit slab(size_t blocks_per_chunk=default_blocks_per_chunk, bool thread_safe=true)
+      : blocks_per_chunk_(blocks_per_chunk), mutex_(thread_safe) {}
+    slab(const slab&) = delete;
+
+    void* allocate(size_t size) {
+      {
+        std::lock_guard<utility::optional_mutex> lock{mutex_};
+        if (block_size_ == 0) block_size_ = round_up(std::max(size, sizeof(free_block)));
+        if (size <= block_size_) {
+          if (!free_blocks_) this->grow();
+          auto block = free_blocks_;
+          free_blocks_ = block->next;
+          return block;
+        }
+      }
+      return ::operator new(size);
+    }
+
+    void deallocate(void* pointer, size_t size) {
+      {
+        std::lock_guard<utility::optional_mutex> lock{mutex_};
+        if (size <= block_size_) {
+          free_blocks_ = new (pointer) free_block{free_blocks_};
+          return;
+        }
+      }
+      ::operator delete(pointer);
+    }
+
+  private:
+    struct free_block {
+      free_block* next;
+    };
+
+    static size_t round_up(size_t size) {
+      constexpr auto alignment = alignof(std::max_align_t);
+      return (size + alignment - 1) / alignment * alignment;
+    }
+
+    void grow() {
+      auto& chunk = chunks_.emplace_back(new char[block_size_ * blocks_per_chunk_]);
+      for (size_t index = blocks_per_chunk_; index > 0; index--) {
+        free_blocks_ = new (chunk.get() + (index - 1) * block_size_) free_block{free_blocks_};
+      }
+    }
+
+    size_t block_size_ = 0;
+    size_t blocks_per_chunk_;
+    free_block* free_blocks_ = nullptr;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    utility::optional_mutex mutex_;
+  };
+
+
+  /**
+   * Allocator over a shared slab, meant for std::allocate_shared. The allocator ends up stored next to every object
+   * it allocates, so the slab stays around until the last of them is gone even if its owner is destroyed first.
+   */
+  template<typename T>
+  class slab_allocator {
+  public:
+    typedef T value_type;
+
+    explicit slab_allocator(std::shared_ptr<slab> slab) noexcept : slab_(std::move(slab)) {}
+    template<typename U> slab_allocator(const slab_allocator<U>& other) noexcept : slab_(other.slab_) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(slab_->allocate(sizeof(T) * count)); }
+    void deallocate(T* pointer, size_t count) { slab_->deallocate(pointer, sizeof(T) * count); }
+
+    bool operator==(const slab_allocator& other) const noexcept { return slab_ == other.slab_; }
+    bool operator!=(const slab_allocator& other) const noexcept { return slab_ != other.slab_; }
+
+  private:
+    template<typename> friend class slab_allocator;
+    std::shared_ptr<slab> slab_;
+  };
+
+}
+
+#endif //SUSPIRIA_SLAB_H
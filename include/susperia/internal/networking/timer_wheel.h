@@ -0,0 +1,153 @@
+//
+// Created by Peyman Mortazavi on 2019-05-14.
+//
+
+#ifndef SUSPIRIA_TIMER_WHEEL_H
+#define SUSPIRIA_TIMER_WHEEL_H
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "susperia/internal/utility.h"
+#include "handler_memory.h"
+
+
+namespace suspiria::networking {
+
+  /**
+   * A hashed timer wheel for the deadlines of many connections. Timers are intrusive and sit in one of the slots of the
+   * wheel, so arming, re-arming and cancelling them is O(1) and never allocates. A single steady_timer ticks the wheel
+   * and fires whatever is due in the current slot. Deadlines longer than a turn of the wheel just wait for a few more
+   * turns. A deadline fires up to one resolution late, which is more than enough for connection timeouts.
+   *
+   * Wheels are owned through shared pointers, the pending tick keeps the wheel alive until it is stopped.
+   */
+  class timer_wheel : public std::enable_shared_from_this<timer_wheel> {
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    static constexpr clock::duration default_resolution = std::chrono::milliseconds(100);
+    static constexpr size_t default_slots = 512;
+
+    /**
+     * A deadline that can be armed on a wheel. Owners have to cancel their timers before they start being destroyed.
+     */
+    class timer {
+    public:
+      timer() = default;
+      timer(const timer&) = delete;
+      virtual ~timer() = default;
+
+    protected:
+      /**
+       * Called on the wheel's thread once the deadline passes, while the wheel is locked. It must not touch the wheel,
+       * anything more than flagging or posting work should be posted (e.g. to the strand of a connection).
+       */
+      virtual void expired() = 0;
+
+    private:
+      friend class timer_wheel;
+      timer_wheel* wheel_ = nullptr;
+      timer* previous_ = nullptr;
+      timer* next_ = nullptr;
+      size_t slot_ = 0;
+      size_t rounds_ = 0;
+    };
+
+    /**
+     * @param io The io_context the wheel ticks on.
+     * @param thread_safe Whether timers get armed from more than one thread.
+     * @param resolution Time between two ticks.
+     * @param slots Number of slots, a turn of the wheel takes slots * resolution.
+     */
+    explicit timer_wheel(
+      asio::io_context& io, bool thread_safe=true, clock::duration resolution=default_resolution,
+      size_t slots=default_slots
+    ) : ticker_(io), mutex_(thread_safe), resolution_(resolution), slots_(slots, nullptr) {}
+    timer_wheel(const timer_wheel&) = delete;
+
+    void start() {
+      next_tick_ = clock::now() + resolution_;
+      this->run_tick_loop();
+    }
+
+    void stop() {
+      asio::error_code ec;
+      ticker_.cancel(ec);
+    }
+
+    /**
+     * Arms the timer to expire after the given timeout, replacing its current deadline if it has one.
+     */
+    void schedule(timer& timer, clock::duration timeout) {
+      auto ticks = std::max<size_t>(1, (timeout + resolution_ - clock::duration(1)) / resolution_);
+      std::lock_guard<utility::optional_mutex> lock{mutex_};
+      if (timer.wheel_) this->unlink(timer);
+      timer.wheel_ = this;
+      timer.slot_ = (cursor_ + ticks) % slots_.size();
+      timer.rounds_ = (ticks - 1) / slots_.size();
+      timer.previous_ = nullptr;
+      timer.next_ = slots_[timer.slot_];
+      if (timer.next_) timer.next_->previous_ = &timer;
+      slots_[timer.slot_] = &timer;
+    }
+
+    void cancel(timer& timer) {
+      std::lock_guard<utility::optional_mutex> lock{mutex_};
+      if (timer.wheel_) this->unlink(timer);
+    }
+
+  private:
+    void unlink(timer& timer) {
+      if (timer.previous_) {
+        timer.previous_->next_ = timer.next_;
+      } else {
+        slots_[timer.slot_] = timer.next_;
+      }
+      if (timer.next_) timer.next_->previous_ = timer.previous_;
+      timer.wheel_ = nullptr;
+      timer.previous_ = timer.next_ = nullptr;
+    }
+
+    void run_tick_loop() {
+      ticker_.expires_at(next_tick_);
+      ticker_.async_wait(bind_memory(memory_, [this, self = shared_from_this()](const auto& error_code) {
+        if (error_code) return;
+        // catches up on every tick that was missed if the thread was busy for longer than the resolution.
+        for (auto now = clock::now(); next_tick_ <= now; next_tick_ += resolution_) this->tick();
+        this->run_tick_loop();
+      }));
+    }
+
+    void tick() {
+      std::lock_guard<utility::optional_mutex> lock{mutex_};
+      cursor_ = (cursor_ + 1) % slots_.size();
+      for (auto timer = slots_[cursor_]; timer;) {
+        auto next = timer->next_;
+        if (timer->rounds_ > 0) {
+          timer->rounds_--;
+        } else {
+          this->unlink(*timer);
+          timer->expired();
+        }
+        timer = next;
+      }
+    }
+
+    asio::steady_timer ticker_;
+    handler_memory memory_;
+    utility::optional_mutex mutex_;
+    clock::duration resolution_;
+    clock::time_point next_tick_;
+    size_t cursor_ = 0;
+    std::vector<timer*> slots_;
+  };
+
+}
+
+#endif //SUSPIRIA_TIMER_WHEEL_H
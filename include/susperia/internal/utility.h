@@ -7,7 +7,9 @@
 
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 
 #include "exceptions.h"
 
@@ -48,23 +50,73 @@ namespace suspiria {
 
 
     /**
-     * String splitter used to split text.
+     * A mutex that can be turned off for objects that end up being used by a single thread only. Locking a disabled
+     * mutex is a no-op, so the same code serves both the shared and the shared-nothing setups.
+     */
+    class optional_mutex {
+    public:
+      explicit optional_mutex(bool enabled=true) : enabled_(enabled) {}
+      optional_mutex(const optional_mutex&) = delete;
+
+      void lock() { if (enabled_) mutex_.lock(); }
+      void unlock() { if (enabled_) mutex_.unlock(); }
+
+    private:
+      bool enabled_;
+      std::mutex mutex_;
+    };
+
+
+    /**
+     * A file mapped into memory read only, it stays mapped for as long as the object is around. Pages are only read
+     * from the disk when they're touched, so opening one costs the same no matter how big the file is.
+     */
+    class mapped_file {
+    public:
+      /**
+       * @throws std::system_error if the file can't be opened or mapped.
+       */
+      explicit mapped_file(const std::string& path);
+      mapped_file(const mapped_file&) = delete;
+      ~mapped_file();
+
+      const char* data() const noexcept { return data_; }
+      size_t size() const noexcept { return size_; }
+
+    private:
+      const char* data_ = nullptr;
+      size_t size_ = 0;
+    };
+
+
+    /**
+     * String splitter used to split text. It only ever looks at the text through a view, words handed out as views
+     * point straight into the text so splitting a path costs no allocation at all.
      */
     class string_partitioner {
     public:
-      explicit string_partitioner(const std::string& text, char separator='/') : text_(text), separator_(separator) {}
+      explicit string_partitioner(std::string_view text, char separator='/') : text_(text), separator_(separator) {}
+
+      bool next(std::string_view& word) noexcept {
+        auto start = text_.find_first_not_of(separator_);
+        if (start == std::string_view::npos) return false;
+        text_.remove_prefix(start);
+        word = text_.substr(0, text_.find(separator_));
+        text_.remove_prefix(word.size());
+        return true;
+      }
+
       bool next(std::string& word);
-      template<typename T> static void for_each(const std::string& text, T func, char separator='/') {
+
+      template<typename T> static void for_each(std::string_view text, T func, char separator='/') {
         string_partitioner it{text, separator};
         std::string route;
         while (it.next(route)) func(route);
       }
 
     private:
-      const std::string& text_;
+      std::string_view text_;
       char separator_;
-      unsigned long start_ = 0;
-      unsigned long count_ = 0;
     };
 
   }
@@ -99,7 +99,7 @@ double timeit(PerformMethod&& perform) {
 using namespace asio;
 
 unique_ptr<HttpResponse> handle(HttpRequest& request) {
-  auto response = make_unique<HttpResponse>();
+  auto response = request.make_response();
   response->headers["Server"] = "suspiria";
   response->headers["Date"] = "January 17th, 2018";
   response->headers["Connection"] = "close";
@@ -2,6 +2,9 @@
 // Created by Peyman Mortazavi on 2019-02-11.
 //
 
+#include <array>
+#include <charconv>
+
 #include <susperia/internal/networking/routing/graph_router.h>
 
 using namespace std;
@@ -14,20 +17,28 @@ regex create_regex(const string& pattern) {
 
 
 RegexRouteMatcher::RegexRouteMatcher(const string &pattern, vector<string>&& capture_names) {
-  this->pattern_ = create_regex(pattern);
+  this->compiled_ = PathRegex::compile(pattern);
+  if (!this->compiled_) this->pattern_ = create_regex(pattern);
   this->names_ = move(capture_names);
 }
 
 RegexRouteMatcher::RegexRouteMatcher(const string &pattern, const vector<string>& capture_names) {
-  this->pattern_ = create_regex(pattern);
+  this->compiled_ = PathRegex::compile(pattern);
+  if (!this->compiled_) this->pattern_ = create_regex(pattern);
   this->names_ = capture_names;
 }
 
-bool RegexRouteMatcher::match(const string &route, RouteParams &params) const noexcept {
-  smatch results;
-  if (regex_match(route, results, pattern_)) {
-    for (unsigned long index = 1; index < results.size(); index++) {
-      params[names_[index-1]] = results.str(index);
+bool RegexRouteMatcher::match(string_view route, RouteParams &params) const noexcept {
+  if (compiled_) {
+    return compiled_->match(route, [this, &params](size_t index, string_view value) {
+      if (index < names_.size()) params.set(names_[index], value);
+    });
+  }
+
+  cmatch results;
+  if (regex_match(route.data(), route.data() + route.size(), results, pattern_)) {
+    for (unsigned long index = 1; index < results.size() && index <= names_.size(); index++) {
+      params.set(names_[index-1], {results[index].first, static_cast<size_t>(results[index].length())});
     }
     return true;
   }
@@ -39,4 +50,102 @@ shared_ptr<RegexRouteMatcher> RegexRouteMatcher::create_from_args(RouteMatcherAr
   auto pattern = args[0];
   args.erase(args.begin());
   return make_shared<RegexRouteMatcher>(pattern, move(args));
-}
\ No newline at end of file
+}
+
+
+/*
+ * from_chars takes care of the overflow checks, as long as the whole text gets used up. It is fine with a minus sign
+ * but not with a plus sign or any white space, which is just what a path segment should be held to.
+ */
+template<typename T>
+static bool parse_integer(string_view text, RouteParams::typed_value& value, int base=10) noexcept {
+  T result;
+  auto [end, error] = from_chars(text.data(), text.data() + text.size(), result, base);
+  if (error != errc{} || end != text.data() + text.size()) return false;
+  value = result;
+  return true;
+}
+
+/*
+ * Up to 18 digits can't overflow any 64 bit integer, which covers about every id out there with a plain loop. Longer
+ * numbers go through from_chars for the overflow checks.
+ */
+static constexpr size_t max_safe_digits = 18;
+
+static bool parse_digits(string_view text, uint64_t& result) noexcept {
+  if (text.empty()) return false;
+  uint64_t value = 0;
+  for (auto character : text) {
+    auto digit = static_cast<unsigned>(character - '0');
+    if (digit > 9) return false;
+    value = value * 10 + digit;
+  }
+  result = value;
+  return true;
+}
+
+/*
+ * Value of every hex digit, -1 for any other character.
+ */
+static constexpr auto hex_digits = [] {
+  array<int8_t, 256> digits{};
+  for (auto& digit : digits) digit = -1;
+  for (int index = 0; index < 10; index++) digits['0' + index] = static_cast<int8_t>(index);
+  for (int index = 0; index < 6; index++) {
+    digits['a' + index] = digits['A' + index] = static_cast<int8_t>(10 + index);
+  }
+  return digits;
+}();
+
+static int hex_digit(char character) noexcept {
+  return hex_digits[static_cast<unsigned char>(character)];
+}
+
+bool IntValidator::parse(string_view text, RouteParams::typed_value& value) noexcept {
+  auto negative = !text.empty() && text[0] == '-';
+  auto digits = negative ? text.substr(1) : text;
+  if (digits.size() > max_safe_digits) return parse_integer<int64_t>(text, value);
+  uint64_t result;
+  if (!parse_digits(digits, result)) return false;
+  value = negative ? -static_cast<int64_t>(result) : static_cast<int64_t>(result);
+  return true;
+}
+
+bool UintValidator::parse(string_view text, RouteParams::typed_value& value) noexcept {
+  if (text.size() > max_safe_digits) return parse_integer<uint64_t>(text, value);
+  uint64_t result;
+  if (!parse_digits(text, result)) return false;
+  value = result;
+  return true;
+}
+
+bool UuidValidator::parse(string_view text, RouteParams::typed_value& value) noexcept {
+  if (text.size() != 36 || text[8] != '-' || text[13] != '-' || text[18] != '-' || text[23] != '-') return false;
+  static constexpr uint8_t offsets[16] = {0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34};
+  Uuid uuid;
+  int invalid = 0;  // collects the sign bits of the digits instead of branching on every single one of them.
+  for (size_t byte = 0; byte < uuid.size(); byte++) {
+    auto high = hex_digit(text[offsets[byte]]), low = hex_digit(text[offsets[byte] + 1]);
+    invalid |= high | low;
+    // shifted as unsigned, an invalid digit is -1 and shifting that as an int is undefined. The byte is dropped then.
+    uuid[byte] = static_cast<uint8_t>(static_cast<unsigned>(high) << 4 | static_cast<unsigned>(low));
+  }
+  if (invalid < 0) return false;
+  value = uuid;
+  return true;
+}
+
+bool SlugValidator::parse(string_view text, RouteParams::typed_value&) noexcept {
+  return !text.empty() && all_of(begin(text), end(text), [](char character) {
+    return (character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z') ||
+           (character >= '0' && character <= '9') || character == '-' || character == '_';
+  });
+}
+
+bool HexValidator::parse(string_view text, RouteParams::typed_value& value) noexcept {
+  if (text.empty() || !all_of(begin(text), end(text), [](char character) { return hex_digit(character) >= 0; })) {
+    return false;
+  }
+  if (text.size() <= 16) parse_integer<uint64_t>(text, value, 16);
+  return true;
+}
@@ -2,7 +2,11 @@
 // Created by Peyman Mortazavi on 2019-02-07.
 //
 
+#include <charconv>
+#include <climits>
 #include <iostream>
+#include <memory_resource>
+#include <optional>
 #include <vector>
 
 #include "http_parser.h"
@@ -13,13 +17,49 @@ using namespace std;
 using namespace suspiria::networking;
 
 
+/*
+ * A monotonic arena for everything that lives as long as a request and its response: the request pieces that outlive
+ * a single read, its body, the response and whatever it allocates. Its first chunk is a slab borrowed from the
+ * connection's buffer pool and given back once the connection goes quiet, so idle connections hold no memory for it
+ * and busy ones never hit malloc unless a request outgrows the slab.
+**/
+class request_arena {
+public:
+  explicit request_arena(buffer_pool& buffers) : buffers_(buffers) {}
+  request_arena(const request_arena&) = delete;
+
+  pmr::memory_resource* resource() {
+    if (!resource_) {
+      slab_ = buffers_.acquire();
+      resource_.emplace(slab_.get(), buffers_.slab_size());
+    }
+    return &*resource_;
+  }
+
+  void release() {
+    if (!resource_) return;
+    resource_.reset();
+    buffers_.release(move(slab_));
+    slab_.reset();
+  }
+
+private:
+  buffer_pool& buffers_;
+  unique_ptr<char[]> slab_;
+  optional<pmr::monotonic_buffer_resource> resource_;
+};
+
+
 /*
  * The HTTP implementation.
 **/
 class http : public protocol {
 public:
-  http(tcp_connection& connection, http_delegate& delegate) : protocol(connection), delegate_(delegate), request_(connection) {
+  http(tcp_connection& connection, http_delegate& delegate, const http_timeouts& timeouts, const http_limits& limits)
+    : protocol(connection), arena_(connection.get_buffer_pool()), request_(connection), delegate_(delegate),
+      timeouts_(timeouts), limits_(limits) {
     http_parser_init(&parser_, HTTP_REQUEST);
+    http_parser_settings_init(&parser_settings_);
     parser_.data = this;
     parser_settings_.on_message_begin = &on_msg_begin;
     parser_settings_.on_url = &on_url;
@@ -31,89 +71,399 @@ public:
   }
   http(const http& another) = delete;
 
-  void connection_made() override {}
+  void connection_made() override {
+    connection_.set_write_timeout(timeouts_.write);
+    this->release_arena_if_idle();  // starts the keep-alive timeout, the client has that long to send a request.
+  }
   void connection_lost() override {}
 
+  void data_written(size_t writes) override {
+    // flushes go out in order, so the oldest responses are the ones that were just sent.
+    size_t sent = 0;
+    for (auto it = begin(flushes_); it != begin(flushes_) + writes; it++) {
+      sent += it->responses;
+      unsent_bytes_ -= it->bytes;
+    }
+    flushes_.erase(begin(flushes_), begin(flushes_) + writes);
+    responses_.erase(begin(responses_), begin(responses_) + sent);
+    this->release_arena_if_idle();
+    if (HTTP_PARSER_ERRNO(&parser_) == HPE_PAUSED && !this->is_backed_up()) this->resume_parsing();
+  }
+
+  /*
+   * Every complete request in the received data gets handled right away and its response gets queued in request
+   * order. Once the data is parsed, all queued responses are flushed together with one gathered write, so a client
+   * pipelining many requests in one packet gets all of its responses back with a single syscall.
+   */
   void data_received(const char* bytes, size_t length) override {
-    http_parser_execute(&parser_, &parser_settings_, bytes, length);
+    auto parsed = this->parse({bytes, length});
+    if (HTTP_PARSER_ERRNO(&parser_) == HPE_PAUSED) backlog_.assign(bytes + parsed, length - parsed);
   }
 
 private:
-  static int on_headers_complete(http_parser* parser) { return 0; }
+  static int on_headers_complete(http_parser* parser) {
+    auto self = reinterpret_cast<http*>(parser->data);
+    self->connection_.set_read_timeout(self->timeouts_.body);  // the body may take a while, as long as it moves.
+    self->delegate_.headers_received(self->request_);
+    if (!self->request_.is_body_streamed() && parser->content_length != ULLONG_MAX) {
+      if (parser->content_length > self->limits_.max_buffered_body) return self->reject(HttpStatus::PayloadTooLarge);
+      // the length comes from the client, so only trust it up to a point.
+      self->request_.body.reserve(min<uint64_t>(parser->content_length, max_body_preallocation));
+    }
+    return 0;
+  }
+
   static int on_url(http_parser* parser, const char* at, size_t length) {
     auto self = reinterpret_cast<http*>(parser->data);
-    self->request_.uri.append(at, length);
+    self->request_.uri = self->join(self->request_.uri, {at, length});
     self->request_.method = static_cast<HttpMethod>(self->parser_.method);
     return 0;
   }
 
   static int on_body(http_parser* parser, const char* at, size_t length) {
+    auto self = reinterpret_cast<http*>(parser->data);
+    auto& request = self->request_;
+    if (!request.is_body_streamed() && request.body.size() + length > self->limits_.max_buffered_body) {
+      return self->reject(HttpStatus::PayloadTooLarge);  // a chunked body, its length isn't known up front.
+    }
+    self->connection_.set_read_timeout(self->timeouts_.body);
+    request.append_body({at, length});
     return 0;
   }
 
   static int on_header_field(http_parser* parser, const char* at, size_t length) {
     auto self = reinterpret_cast<http*>(parser->data);
-    if (self->should_clear_key_) {
-      self->header_key_.clear();
-      self->should_clear_key_ = false;
+    if (self->last_header_part_ == header_part::name) {  // the rest of a name that started in the previous read.
+      auto& name = self->request_.headers.back().name;
+      name = self->join(name, {at, length});
+    } else {
+      self->request_.headers.add({at, length});
+      self->last_header_part_ = header_part::name;
     }
-    self->header_key_.append(at, length);
     return 0;
   }
 
   static int on_header_value(http_parser* parser, const char* at, size_t length) {
     auto self = reinterpret_cast<http*>(parser->data);
-    self->request_.headers[self->header_key_].append(at, length);
-    self->should_clear_key_ = true;
+    auto& value = self->request_.headers.back().value;
+    if (self->last_header_part_ == header_part::value) {  // the rest of a value that started in the previous read.
+      value = self->join(value, {at, length});
+    } else {
+      value = {at, length};
+      self->last_header_part_ = header_part::value;
+    }
     return 0;
   }
 
   static int on_msg_begin(http_parser* parser) {
     auto self = reinterpret_cast<http*>(parser->data);
-    self->request_.reset();
+    self->request_.reset(self->arena_.resource());
+    self->last_header_part_ = header_part::none;
+    self->in_message_ = true;
+    self->is_idle_ = false;
+    self->connection_.set_read_timeout(self->timeouts_.request_header);
     return 0;
   }
 
   static int on_msg_complete(http_parser* parser) {
     auto self = reinterpret_cast<http*>(parser->data);
-    self->request_.keep_alive = self->parser_.flags & flags::F_CONNECTION_KEEP_ALIVE;
-    self->delegate_.handle(self->request_)->write(self->request_);
-    if (!self->request_.keep_alive)
-      self->connection_.close();
+    self->in_message_ = false;
+    self->connection_.clear_read_timeout();  // the keep-alive timeout takes over once the response is sent.
+    self->request_.keep_alive = http_should_keep_alive(parser);
+    self->queue(self->delegate_.handle(self->request_));
+    if (!self->request_.keep_alive) return 1;  // stop parsing, anything pipelined after this request gets dropped.
+    if (self->is_backed_up()) {  // the client isn't reading its responses fast enough, stop taking requests from it.
+      http_parser_pause(parser, 1);
+      self->connection_.pause_reading();
+    }
     return 0;
   }
 
-  bool should_clear_key_ = false;
-  string header_key_;
+  /*
+   * Queues the response of the current request, it goes out with the next flush.
+   */
+  void queue(unique_ptr<HttpResponse> response) {
+    auto first_buffer = write_buffers_.size();
+    response->write(write_buffers_, request_.method != HEAD);
+    for (auto index = first_buffer; index < write_buffers_.size(); index++) {
+      unflushed_.bytes += write_buffers_[index].size();
+      unsent_bytes_ += write_buffers_[index].size();
+    }
+    responses_.emplace_back(std::move(response));  // keeps the response alive until it is sent.
+    unflushed_.responses++;
+  }
+
+  /*
+   * Answers the request in progress with the given status without handing it to the delegate. The rest of the
+   * request never gets read, so the connection closes once the answer is sent.
+   * @return What the parser callback returns to stop the parser.
+   */
+  int reject(HttpStatus status) {
+    in_message_ = false;
+    auto response = request_.make_response();
+    response->status = status;
+    response->headers["Connection"] = "close";
+    this->queue(std::move(response));
+    return -1;
+  }
+
+  /*
+   * Parses the data and flushes the responses of the requests it completes. The parser pauses once too many responses
+   * wait to be sent, in which case the rest of the data is left unparsed.
+   * @return The number of bytes parsed.
+   */
+  size_t parse(string_view data) {
+    auto parsed = http_parser_execute(&parser_, &parser_settings_, data.data(), data.size());
+    if (in_message_) this->spill(data);
+    this->flush();
+    this->release_arena_if_idle();
+    auto error = HTTP_PARSER_ERRNO(&parser_);
+    if (error != HPE_OK && error != HPE_PAUSED) {  // either a malformed request or a request that ends the connection.
+      connection_.close_after_writing();
+    }
+    return parsed;
+  }
+
+  /*
+   * Picks up where the parser paused once enough responses are sent: the data left over from the last read first,
+   * then the socket again. Pausing once more keeps whatever is still left over.
+   */
+  void resume_parsing() {
+    http_parser_pause(&parser_, 0);
+    backlog_.erase(0, this->parse(backlog_));
+    if (HTTP_PARSER_ERRNO(&parser_) != HPE_PAUSED) backlog_.clear();
+    if (HTTP_PARSER_ERRNO(&parser_) == HPE_OK) connection_.resume_reading();
+  }
+
+  bool is_backed_up() const noexcept {
+    return responses_.size() >= max_unsent_responses || unsent_bytes_ >= max_unsent_bytes;
+  }
+
+  /*
+   * Header views point straight into the receive buffer which goes back to the buffer pool once the data is handled,
+   * so the headers of a request that is still in progress get copied into the arena before that happens.
+   */
+  void spill(string_view buffer) {
+    auto in_buffer = [&buffer](string_view text) {
+      return !text.empty() && text.data() >= buffer.data() && text.data() < buffer.data() + buffer.size();
+    };
+    if (in_buffer(request_.uri)) request_.uri = this->join(request_.uri, {});
+    for (auto& header : request_.headers) {
+      if (in_buffer(header.name)) header.name = this->join(header.name, {});
+      if (in_buffer(header.value)) header.value = this->join(header.value, {});
+    }
+  }
+
+  string_view join(string_view first, string_view second) {
+    if (first.empty()) return second;
+    if (first.data() + first.size() == second.data()) return {first.data(), first.size() + second.size()};
+    auto data = static_cast<char*>(arena_.resource()->allocate(first.size() + second.size(), 1));
+    copy(begin(first), end(first), data);
+    copy(begin(second), end(second), data + first.size());
+    return {data, first.size() + second.size()};
+  }
+
+  /*
+   * The arena can only start over once nothing points into it anymore: no request in progress and no response
+   * waiting to be sent. Pipelined requests keep piling up in it until then. That is also when the connection turns
+   * idle and the keep-alive timeout starts, it stops again as soon as the next request begins.
+   */
+  void release_arena_if_idle() {
+    if (in_message_ || !responses_.empty()) return;
+    request_.reset();  // lets go of the body before its arena goes.
+    arena_.release();
+    if (!is_idle_) {
+      is_idle_ = true;
+      connection_.set_read_timeout(timeouts_.keep_alive);
+    }
+  }
+
+  void flush() {
+    if (!unflushed_.responses) return;
+    flushes_.push_back(unflushed_);
+    unflushed_ = {};
+    connection_.write(write_buffers_);
+    write_buffers_.clear();
+  }
+
+  enum class header_part { none, name, value };
+
+  /*
+   * The responses of a flush and their size, kept until the flush is sent.
+   */
+  struct flush_size {
+    size_t responses = 0;
+    size_t bytes = 0;
+  };
+
+  static constexpr uint64_t max_body_preallocation = 1024 * 1024;
+  // pipelined requests are only parsed while fewer responses than this, and fewer bytes, wait to be sent.
+  static constexpr size_t max_unsent_responses = 64;
+  static constexpr size_t max_unsent_bytes = 1024 * 1024;
+
+  header_part last_header_part_ = header_part::none;
+  bool in_message_ = false;
+  bool is_idle_ = false;
+  request_arena arena_;
   HttpRequest request_;
+  vector<unique_ptr<HttpResponse>> responses_;  // responses in request order, until they are sent.
+  vector<flush_size> flushes_;  // the flushes that are not sent yet, oldest first.
+  flush_size unflushed_;
+  size_t unsent_bytes_ = 0;  // of every response in responses_.
+  vector<asio::const_buffer> write_buffers_;
+  string backlog_;  // what's left of the last read while the parser is paused.
   http_parser parser_;
   http_parser_settings parser_settings_;
   http_delegate& delegate_;
+  http_timeouts timeouts_;
+  http_limits limits_;
+};
+
+
+static const string newline = "\r\n";
+static const string header_separator = ": ";
+static const char content_length_header[] = "Content-Length";
+
+
+/*
+ * Every response starts with a small header that remembers which memory resource it came from, so deleting it
+ * through a plain unique_ptr gives the memory back to the right place.
+ */
+struct alignas(alignof(max_align_t)) allocation_header {
+  pmr::memory_resource* resource;
+  size_t size;
 };
 
 
-static string newline = "\r\n";
+void* HttpResponse::operator new(size_t size, pmr::memory_resource* resource) {
+  if (!resource) resource = pmr::new_delete_resource();
+  auto total = sizeof(allocation_header) + size;
+  auto header = new (resource->allocate(total, alignof(allocation_header))) allocation_header{resource, total};
+  return header + 1;
+}
+
+void* HttpResponse::operator new(size_t size) {
+  return HttpResponse::operator new(size, nullptr);
+}
+
+void HttpResponse::operator delete(void* pointer) {
+  if (!pointer) return;
+  auto header = static_cast<allocation_header*>(pointer) - 1;
+  header->resource->deallocate(header, header->size, alignof(allocation_header));
+}
+
+void HttpResponse::operator delete(void* pointer, pmr::memory_resource*) {
+  HttpResponse::operator delete(pointer);
+}
+
+
+static bool iequals(string_view first, string_view second) noexcept {
+  if (first.size() != second.size()) return false;
+  for (size_t index = 0; index < first.size(); index++) {
+    if (tolower(static_cast<unsigned char>(first[index])) != tolower(static_cast<unsigned char>(second[index])))
+      return false;
+  }
+  return true;
+}
 
 
-void HttpResponse::write(HttpRequest& request) {
-  string result;
-  result += "HTTP/1.1 ";
-  result += to_string(this->status);
-  result += " OK";
-  result += newline;
+const HttpHeaders::header* HttpHeaders::find(string_view name) const noexcept {
+  for (auto& item : headers_) {
+    if (iequals(item.name, name)) return &item;
+  }
+  return nullptr;
+}
+
+
+/**
+ * The status line of the statuses HttpStatus names, empty for any other value.
+ */
+static string_view status_line(HttpStatus status) noexcept {
+  switch (status) {
+    case HttpStatus::OK: return "HTTP/1.1 200 OK\r\n";
+    case HttpStatus::BadRequest: return "HTTP/1.1 400 Bad Request\r\n";
+    case HttpStatus::NotFound: return "HTTP/1.1 404 Not Found\r\n";
+    case HttpStatus::MethodNotAllowed: return "HTTP/1.1 405 Method Not Allowed\r\n";
+    case HttpStatus::PayloadTooLarge: return "HTTP/1.1 413 Payload Too Large\r\n";
+  }
+  return {};
+}
+
+
+void HttpResponse::write(vector<asio::const_buffer>& buffers, bool with_body) {
+  auto line = status_line(this->status);
+  if (line.empty()) {  // a status made from its code goes out with the code alone, the reason phrase may be empty.
+    static constexpr string_view version = "HTTP/1.1 ";
+    auto cursor = copy(begin(version), end(version), status_line_);
+    cursor = to_chars(cursor, end(status_line_), static_cast<int>(this->status)).ptr;
+    *cursor++ = ' ';
+    cursor = copy(begin(newline), end(newline), cursor);
+    line = string_view(status_line_, cursor - status_line_);
+  }
+  buffers.emplace_back(asio::buffer(line.data(), line.size()));
+  bool has_length = false;
   for (auto& item : headers) {
-    result += item.first;
-    result += ": ";
-    result += item.second;
-    result += newline;
+    has_length = has_length || iequals(item.first, content_length_header);
+    buffers.emplace_back(asio::buffer(item.first));
+    buffers.emplace_back(asio::buffer(header_separator));
+    buffers.emplace_back(asio::buffer(item.second));
+    buffers.emplace_back(asio::buffer(newline));
+  }
+  if (!has_length) {
+    auto cursor = copy(begin(content_length_header), end(content_length_header) - 1, content_length_);
+    cursor = copy(begin(header_separator), end(header_separator), cursor);
+    cursor = to_chars(cursor, end(content_length_), body.size()).ptr;
+    cursor = copy(begin(newline), end(newline), cursor);
+    buffers.emplace_back(asio::buffer(content_length_, cursor - content_length_));
+  }
+  buffers.emplace_back(asio::buffer(newline));
+  if (with_body && !body.empty()) buffers.emplace_back(asio::buffer(body));
+}
+
+
+void routing_delegate::headers_received(HttpRequest& request) {
+  this->route(request);
+  if (request.route_) request.route_->headers_received(request);
+}
+
+
+unique_ptr<HttpResponse> routing_delegate::handle(HttpRequest& request) {
+  // a request that arrived over several reads has its uri moved into the arena, and the params would still point at
+  // the read buffer.
+  if (request.route_uri_ != request.uri.data()) this->route(request);
+  if (request.route_) return request.route_->handle(request);
+
+  auto response = request.make_response();
+  if (request.route_allowed_.empty()) {
+    response->status = HttpStatus::NotFound;
+    return response;
   }
-  result += newline;
+  response->status = request.method == OPTIONS ? HttpStatus::OK : HttpStatus::MethodNotAllowed;
+  auto allowed = request.route_allowed_.to_string();
+  response->headers["Allow"].assign(allowed.data(), allowed.size());
+  return response;
+}
+
 
-  asio::error_code err;
-  request.connection_.get_socket().write_some(asio::buffer(result), err);
+void routing_delegate::route(HttpRequest& request) const {
+  auto path = request.uri.substr(0, request.uri.find_first_of("?#"));
+  const Router<http_delegate>* router = request.route_snapshot_.get();  // routed again, stays on the same table.
+  if (!router) {
+    router = hosts_->find(request.headers["Host"]);
+    // resolves on the table a holder has right now and keeps it, a publish can't pull the params out from under us.
+    for (auto table = router ? router->snapshot() : nullptr; table; table = router->snapshot()) {
+      router = table.get();
+      request.route_snapshot_ = move(table);
+    }
+  }
+  auto result = router ? router->resolve(request.method, path) : ResolveResult<http_delegate>{};
+  request.params = move(result.params);
+  request.route_ = result.matched ? move(result.handler) : nullptr;
+  request.route_allowed_ = result.allowed;
+  request.route_uri_ = request.uri.data();
 }
 
 
 unique_ptr<protocol> http_protocol_factory::create_protocol(tcp_connection& connection) {
-  return make_unique<http>(connection, *delegate_);
+  return make_unique<http>(connection, *delegate_, timeouts_, limits_);
 }
\ No newline at end of file
@@ -0,0 +1,761 @@
+//
+// Created by Peyman Mortazavi on 2019-05-22.
+//
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include <susperia/internal/networking/routing/path_regex.h>
+
+using namespace std;
+using namespace suspiria::networking;
+
+
+namespace {
+
+  typedef bitset<256> character_set;
+
+  constexpr size_t max_program_size = 8192;  // guards against things like (a{100}){100}.
+  constexpr size_t max_dfa_states = 1024;
+  constexpr size_t max_set_states = 4096;
+  constexpr size_t max_backtrack_bits = 256 * 1024;  // instructions times positions, 32KiB worth of visited flags.
+  constexpr uint32_t unbounded = UINT32_MAX;
+
+
+  struct unsupported {};  // thrown for anything the engine doesn't do, the caller falls back on std::regex.
+
+
+  struct node {
+    enum class type { set, sequence, alternation, repetition, group };
+
+    explicit node(type kind) noexcept : kind(kind) {}
+
+    type kind;
+    uint32_t set = 0;
+    vector<node> children;
+    uint32_t min = 0, max = 0;  // repetition counts.
+    bool greedy = true;
+    int group = -1;  // index of a capturing group, -1 for non capturing ones.
+  };
+
+
+  character_set range(unsigned char first, unsigned char last) {
+    character_set set;
+    for (auto character = first; character <= last; character++) {
+      set.set(character);
+      if (character == last) break;
+    }
+    return set;
+  }
+
+  character_set digits() { return range('0', '9'); }
+  character_set word_characters() { return range('a', 'z') | range('A', 'Z') | digits() | range('_', '_'); }
+  character_set spaces() { return range('\t', '\r') | range(' ', ' '); }
+
+
+  /*
+   * Recursive descent parser over the ECMAScript grammar, limited to what PathRegex supports.
+   */
+  class parser {
+  public:
+    parser(string_view pattern, vector<character_set>& sets) : pattern_(pattern), sets_(sets) {}
+
+    node parse() {
+      if (this->peek('^')) position_++;
+      auto root = this->parse_alternation();
+      if (this->peek('$') && position_ + 1 == pattern_.size()) position_++;
+      if (position_ != pattern_.size()) throw unsupported{};
+      return root;
+    }
+
+    size_t group_count() const noexcept { return group_count_; }
+
+  private:
+    bool peek(char character) const noexcept {
+      return position_ < pattern_.size() && pattern_[position_] == character;
+    }
+
+    char next() {
+      if (position_ >= pattern_.size()) throw unsupported{};
+      return pattern_[position_++];
+    }
+
+    node make_set(const character_set& set) {
+      sets_.push_back(set);
+      node result{node::type::set};
+      result.set = static_cast<uint32_t>(sets_.size() - 1);
+      return result;
+    }
+
+    node parse_alternation() {
+      node result{node::type::alternation};
+      result.children.push_back(this->parse_sequence());
+      while (this->peek('|')) {
+        position_++;
+        result.children.push_back(this->parse_sequence());
+      }
+      return result.children.size() == 1 ? move(result.children.front()) : move(result);
+    }
+
+    node parse_sequence() {
+      node result{node::type::sequence};
+      while (position_ < pattern_.size() && !this->peek('|') && !this->peek(')')) {
+        if (this->peek('$') && position_ + 1 == pattern_.size()) break;  // the end anchor, handled by parse().
+        result.children.push_back(this->parse_repetition());
+      }
+      return result;
+    }
+
+    node parse_repetition() {
+      auto atom = this->parse_atom();
+      while (position_ < pattern_.size()) {
+        uint32_t min, max;
+        auto character = pattern_[position_];
+        if (character == '*') {
+          min = 0, max = unbounded;
+        } else if (character == '+') {
+          min = 1, max = unbounded;
+        } else if (character == '?') {
+          min = 0, max = 1;
+        } else if (character == '{') {
+          position_++;
+          min = max = this->parse_number();
+          if (this->peek(',')) {
+            position_++;
+            max = this->peek('}') ? unbounded : this->parse_number();
+          }
+          if (!this->peek('}') || max < min) throw unsupported{};
+        } else {
+          break;
+        }
+        position_++;
+        node repetition{node::type::repetition};
+        repetition.min = min;
+        repetition.max = max;
+        if (this->peek('?')) {
+          repetition.greedy = false;
+          position_++;
+        }
+        repetition.children.push_back(move(atom));
+        atom = move(repetition);
+      }
+      return atom;
+    }
+
+    uint32_t parse_number() {
+      uint32_t value = 0;
+      size_t count = 0;
+      for (; position_ < pattern_.size() && isdigit(static_cast<unsigned char>(pattern_[position_])); position_++) {
+        value = value * 10 + (pattern_[position_] - '0');
+        if (++count > 4) throw unsupported{};
+      }
+      if (count == 0) throw unsupported{};
+      return value;
+    }
+
+    node parse_atom() {
+      auto character = this->next();
+      switch (character) {
+        case '(': {
+          node group{node::type::group};
+          if (this->peek('?')) {
+            position_++;
+            if (this->next() != ':') throw unsupported{};  // lookaheads.
+          } else {
+            group.group = static_cast<int>(group_count_++);
+          }
+          group.children.push_back(this->parse_alternation());
+          if (this->next() != ')') throw unsupported{};
+          return group;
+        }
+        case '[': return this->make_set(this->parse_class());
+        case '.': return this->make_set(~(range('\n', '\n') | range('\r', '\r')));
+        case '\\': {
+          character_set set;
+          if (this->parse_class_escape(set)) return this->make_set(set);
+          auto value = this->parse_character_escape();
+          return this->make_set(range(value, value));
+        }
+        case ')': case '|': case '*': case '+': case '?': case '{': case '}': case ']': case '^': case '$':
+          throw unsupported{};
+        default: {
+          auto value = static_cast<unsigned char>(character);
+          return this->make_set(range(value, value));
+        }
+      }
+    }
+
+    /*
+     * Handles \d, \w, \s and their negations, the position is right after the backslash.
+     */
+    bool parse_class_escape(character_set& set) {
+      if (position_ >= pattern_.size()) throw unsupported{};
+      switch (pattern_[position_]) {
+        case 'd': set = digits(); break;
+        case 'D': set = ~digits(); break;
+        case 'w': set = word_characters(); break;
+        case 'W': set = ~word_characters(); break;
+        case 's': set = spaces(); break;
+        case 'S': set = ~spaces(); break;
+        default: return false;
+      }
+      position_++;
+      return true;
+    }
+
+    /*
+     * Handles the escapes that stand for a single character, the position is right after the backslash.
+     */
+    unsigned char parse_character_escape() {
+      auto character = this->next();
+      switch (character) {
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        default:
+          // back references, word boundaries and the likes of \x, \u and \c are left to std::regex.
+          if (isalnum(static_cast<unsigned char>(character))) throw unsupported{};
+          return static_cast<unsigned char>(character);
+      }
+    }
+
+    character_set parse_class() {
+      character_set set;
+      bool negated = false;
+      if (this->peek('^')) {
+        negated = true;
+        position_++;
+      }
+      while (!this->peek(']')) {
+        character_set escaped;
+        unsigned char first;
+        if (this->peek('\\')) {
+          position_++;
+          if (this->parse_class_escape(escaped)) {
+            set |= escaped;
+            continue;
+          }
+          first = this->peek('b') ? (position_++, '\b') : this->parse_character_escape();
+        } else {
+          first = static_cast<unsigned char>(this->next());
+        }
+
+        auto last = first;
+        if (this->peek('-') && position_ + 1 < pattern_.size() && pattern_[position_ + 1] != ']') {
+          position_++;
+          if (this->peek('\\')) {
+            position_++;
+            if (this->parse_class_escape(escaped)) throw unsupported{};  // e.g. [a-\d]
+            last = this->parse_character_escape();
+          } else {
+            last = static_cast<unsigned char>(this->next());
+          }
+          if (last < first) throw unsupported{};
+        }
+        set |= range(first, last);
+      }
+      position_++;  // the closing bracket.
+      return negated ? ~set : set;
+    }
+
+    string_view pattern_;
+    vector<character_set>& sets_;
+    size_t position_ = 0;
+    size_t group_count_ = 0;
+  };
+
+
+  /*
+   * Turns the syntax tree into a program for the Pike VM, every alternative is tried in the order of its priority.
+   */
+  class compiler {
+  public:
+    explicit compiler(vector<PathRegex::instruction>& program) : program_(program) {}
+
+    void compile(const node& root) {
+      this->emit(root);
+      this->add({PathRegex::opcode::match});
+    }
+
+  private:
+    uint32_t add(PathRegex::instruction instruction) {
+      if (program_.size() >= max_program_size) throw unsupported{};
+      program_.push_back(instruction);
+      return static_cast<uint32_t>(program_.size() - 1);
+    }
+
+    uint32_t next() const noexcept { return static_cast<uint32_t>(program_.size()); }
+
+    /*
+     * A split whose branches are filled in later: the body comes first when greedy, whatever follows otherwise.
+     */
+    uint32_t add_split() { return this->add({PathRegex::opcode::split}); }
+
+    void patch_split(uint32_t split, uint32_t body, uint32_t rest, bool greedy) {
+      program_[split].x = greedy ? body : rest;
+      program_[split].y = greedy ? rest : body;
+    }
+
+    void emit(const node& item) {
+      switch (item.kind) {
+        case node::type::set:
+          this->add({PathRegex::opcode::characters, item.set});
+          break;
+        case node::type::sequence:
+          for (auto& child : item.children) this->emit(child);
+          break;
+        case node::type::group:
+          if (item.group >= 0) this->add({PathRegex::opcode::save, static_cast<uint32_t>(item.group * 2)});
+          this->emit(item.children.front());
+          if (item.group >= 0) this->add({PathRegex::opcode::save, static_cast<uint32_t>(item.group * 2 + 1)});
+          break;
+        case node::type::alternation: {
+          vector<uint32_t> jumps;
+          for (size_t index = 0; index < item.children.size(); index++) {
+            if (index + 1 < item.children.size()) {
+              auto split = this->add_split();
+              this->emit(item.children[index]);
+              jumps.push_back(this->add({PathRegex::opcode::jump}));
+              this->patch_split(split, split + 1, this->next(), true);
+            } else {
+              this->emit(item.children[index]);
+            }
+          }
+          for (auto jump : jumps) program_[jump].x = this->next();
+          break;
+        }
+        case node::type::repetition: {
+          auto& body = item.children.front();
+          for (uint32_t count = 0; count < item.min; count++) this->emit(body);
+          if (item.max == unbounded) {
+            auto split = this->add_split();
+            this->emit(body);
+            this->add({PathRegex::opcode::jump, split});
+            this->patch_split(split, split + 1, this->next(), item.greedy);
+          } else {
+            vector<uint32_t> splits;
+            for (auto count = item.min; count < item.max; count++) {
+              splits.push_back(this->add_split());
+              this->emit(body);
+            }
+            for (auto split : splits) this->patch_split(split, split + 1, this->next(), item.greedy);
+          }
+          break;
+        }
+      }
+    }
+
+    vector<PathRegex::instruction>& program_;
+  };
+
+
+  struct automaton_source {
+    const vector<PathRegex::instruction>* program;
+    const vector<character_set>* sets;
+  };
+
+  typedef vector<uint64_t> nfa_states;  // the index of a program in the high half, one of its instructions in the low.
+
+  /*
+   * Subset construction over one or more programs at once, a DFA state is the set of character and match instructions
+   * the programs can be at. Characters that belong to the same sets can't be told apart, they share a class and a
+   * column of the transition table. on_state(state) gets called for every DFA state in order.
+   * @return false if it would take more than max_states states.
+   */
+  template<typename OnState>
+  bool build_automaton(const vector<automaton_source>& sources, size_t max_states, uint8_t* classes,
+                       size_t& class_count, vector<int32_t>& transitions, OnState&& on_state) {
+    map<vector<bool>, uint8_t> signatures;
+    for (size_t character = 0; character < 256; character++) {
+      vector<bool> signature;
+      for (auto& source : sources) {
+        for (auto& set : *source.sets) signature.push_back(set[character]);
+      }
+      auto it = signatures.emplace(move(signature), static_cast<uint8_t>(signatures.size())).first;
+      classes[character] = it->second;
+    }
+    class_count = signatures.size();
+    uint8_t representatives[256];
+    for (size_t character = 0; character < 256; character++) representatives[classes[character]] = character;
+
+    auto closure = [&sources](nfa_states pending) {
+      nfa_states result;
+      vector<vector<bool>> seen(sources.size());
+      while (!pending.empty()) {
+        auto entry = pending.back();
+        pending.pop_back();
+        auto source = static_cast<uint32_t>(entry >> 32), pc = static_cast<uint32_t>(entry);
+        auto& program = *sources[source].program;
+        if (seen[source].empty()) seen[source].resize(program.size());
+        if (seen[source][pc]) continue;
+        seen[source][pc] = true;
+        auto& instruction = program[pc];
+        auto base = uint64_t{source} << 32;
+        switch (instruction.op) {
+          case PathRegex::opcode::jump: pending.push_back(base | instruction.x); break;
+          case PathRegex::opcode::split:
+            pending.push_back(base | instruction.y);
+            pending.push_back(base | instruction.x);
+            break;
+          case PathRegex::opcode::save: pending.push_back(entry + 1); break;
+          default: result.push_back(entry);
+        }
+      }
+      sort(begin(result), end(result));
+      return result;
+    };
+
+    nfa_states start;
+    for (uint64_t source = 0; source < sources.size(); source++) start.push_back(source << 32);
+    map<nfa_states, int32_t> states;
+    vector<nfa_states> queue{closure(move(start))};
+    states.emplace(queue.front(), 0);
+    for (size_t state = 0; state < queue.size(); state++) {
+      if (queue.size() > max_states) return false;
+      auto current = queue[state];
+      on_state(current);
+      for (size_t column = 0; column < class_count; column++) {
+        nfa_states targets;
+        for (auto entry : current) {
+          auto& source = sources[entry >> 32];
+          auto& instruction = (*source.program)[static_cast<uint32_t>(entry)];
+          if (instruction.op != PathRegex::opcode::characters) continue;
+          if ((*source.sets)[instruction.x][representatives[column]]) {
+            targets.push_back(entry + 1);
+          }
+        }
+        int32_t target = -1;
+        if (!targets.empty()) {
+          auto next = closure(move(targets));
+          auto it = states.find(next);
+          if (it == end(states)) {
+            it = states.emplace(next, static_cast<int32_t>(queue.size())).first;
+            queue.push_back(move(next));
+          }
+          target = it->second;
+        }
+        transitions.push_back(target);
+      }
+    }
+    return true;
+  }
+
+
+  /*
+   * An ordered set of program counters with O(1) insertion and lookup, the classic sparse set.
+   */
+  class thread_list {
+  public:
+    void reset(size_t program_size, size_t slots) {
+      sparse_.resize(program_size);
+      dense_.resize(program_size);
+      captures_.resize(program_size * slots);
+      slots_ = slots;
+      size_ = 0;
+    }
+
+    bool contains(uint32_t pc) const noexcept {
+      return sparse_[pc] < size_ && dense_[sparse_[pc]] == pc;
+    }
+
+    void mark(uint32_t pc) noexcept {
+      sparse_[pc] = static_cast<uint32_t>(size_);
+      dense_[size_++] = pc;
+    }
+
+    uint32_t* captures(size_t index) noexcept { return captures_.data() + index * slots_; }
+
+    size_t size() const noexcept { return size_; }
+    uint32_t operator[](size_t index) const noexcept { return dense_[index]; }
+    void clear() noexcept { size_ = 0; }
+
+  private:
+    vector<uint32_t> sparse_;
+    vector<uint32_t> dense_;
+    vector<uint32_t> captures_;
+    size_t slots_ = 0;
+    size_t size_ = 0;
+  };
+
+
+  /*
+   * Memory the Pike VM reuses from one match to the next, matchers are shared between threads so every thread keeps
+   * its own.
+   */
+  struct vm_memory {
+    thread_list current, next;
+    vector<uint32_t> captures, best;
+    vector<uint64_t> visited;
+
+    struct frame {
+      uint32_t pc;
+      uint32_t slot;  // no_position for frames that follow the program, otherwise a capture slot to restore.
+      uint32_t value;  // the position to follow the program at or the value to restore.
+    };
+    vector<frame> stack;
+  };
+
+  vm_memory& get_vm_memory() {
+    thread_local vm_memory memory;
+    return memory;
+  }
+
+}
+
+
+optional<PathRegex> PathRegex::compile(string_view pattern) {
+  PathRegex regex;
+  try {
+    parser reader{pattern, regex.sets_};
+    auto root = reader.parse();
+    regex.group_count_ = reader.group_count();
+    compiler{regex.program_}.compile(root);
+  } catch (const unsupported&) {
+    return nullopt;
+  }
+  regex.build_dfa();
+  return regex;
+}
+
+
+void PathRegex::build_dfa() {
+  auto built = build_automaton({{&program_, &sets_}}, max_dfa_states, classes_, class_count_, transitions_,
+                               [this](const nfa_states& state) {
+    accepting_.push_back(any_of(begin(state), end(state), [this](auto entry) {
+      return program_[static_cast<uint32_t>(entry)].op == opcode::match;
+    }));
+  });
+  if (!built) {  // too big to be worth it, matches will run on the Pike VM alone.
+    transitions_.clear();
+    accepting_.clear();
+  }
+}
+
+
+bool PathRegex::run_dfa(string_view text) const noexcept {
+  int32_t state = 0;
+  for (auto character : text) {
+    state = transitions_[state * class_count_ + classes_[static_cast<unsigned char>(character)]];
+    if (state < 0) return false;
+  }
+  return accepting_[state];
+}
+
+
+bool PathRegex::disjoint(const PathRegex& other) const {
+  if (transitions_.empty() || other.transitions_.empty()) return false;
+  // walks the pairs of states both DFAs get to on the same texts, looking for one where both accept.
+  auto width = other.accepting_.size();
+  vector<bool> visited(accepting_.size() * width);
+  vector<pair<int32_t, int32_t>> pending{{0, 0}};
+  visited[0] = true;
+  while (!pending.empty()) {
+    auto [first, second] = pending.back();
+    pending.pop_back();
+    if (accepting_[first] && other.accepting_[second]) return false;
+    for (size_t character = 0; character < 256; character++) {
+      auto next_first = transitions_[first * class_count_ + classes_[character]];
+      auto next_second = other.transitions_[second * other.class_count_ + other.classes_[character]];
+      if (next_first < 0 || next_second < 0) continue;
+      auto key = static_cast<size_t>(next_first) * width + static_cast<size_t>(next_second);
+      if (visited[key]) continue;
+      visited[key] = true;
+      pending.emplace_back(next_first, next_second);
+    }
+  }
+  return true;
+}
+
+
+bool PathRegex::match(string_view text) const noexcept {
+  if (!transitions_.empty()) return this->run_dfa(text);
+  return this->run_program(text, nullptr);
+}
+
+
+const uint32_t* PathRegex::find_groups(string_view text) const {
+  auto& memory = get_vm_memory();
+  memory.best.assign(group_count_ * 2, no_position);
+  if (program_.size() * (text.size() + 1) <= max_backtrack_bits) {
+    this->backtrack(text, memory.best.data());
+  } else {
+    this->run_program(text, memory.best.data());
+  }
+  return memory.best.data();
+}
+
+
+/*
+ * Tries the alternatives depth first in the order of their priority, just like std::regex does, but never visits the
+ * same instruction at the same position twice: if it didn't lead to a match the first time, it won't the second. That
+ * bounds the work to instructions times positions, which for a path segment is less than what a Pike VM spends
+ * keeping its threads in order.
+ */
+bool PathRegex::backtrack(string_view text, uint32_t* result) const {
+  auto& memory = get_vm_memory();
+  auto slots = group_count_ * 2;
+  auto columns = text.size() + 1;
+  memory.visited.assign((program_.size() * columns + 63) / 64, 0);
+  memory.captures.assign(slots, no_position);
+  auto captures = memory.captures.data();
+  auto& stack = memory.stack;
+  stack.clear();
+  stack.push_back({0, no_position, 0});
+
+  while (!stack.empty()) {
+    auto frame = stack.back();
+    stack.pop_back();
+    if (frame.slot != no_position) {
+      captures[frame.slot] = frame.value;
+      continue;
+    }
+
+    for (auto pc = frame.pc, position = frame.value;;) {
+      auto bit = pc * columns + position;
+      if (memory.visited[bit / 64] & (uint64_t{1} << (bit % 64))) break;
+      memory.visited[bit / 64] |= uint64_t{1} << (bit % 64);
+
+      auto& instruction = program_[pc];
+      if (instruction.op == opcode::characters) {
+        if (position == text.size() || !sets_[instruction.x][static_cast<unsigned char>(text[position])]) break;
+        pc++, position++;
+      } else if (instruction.op == opcode::jump) {
+        pc = instruction.x;
+      } else if (instruction.op == opcode::split) {
+        stack.push_back({instruction.y, no_position, position});
+        pc = instruction.x;
+      } else if (instruction.op == opcode::save) {
+        stack.push_back({0, instruction.x, captures[instruction.x]});
+        captures[instruction.x] = position;
+        pc++;
+      } else {
+        if (position != text.size()) break;
+        copy(captures, captures + slots, result);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+/*
+ * A Pike VM: every thread of the program advances one character at a time, in the order of its priority, so the
+ * first thread to match at the end of the text is the one a backtracking engine would have found. Threads that
+ * reach the same instruction at the same position behave the same from there on, only the higher priority one stays.
+ */
+bool PathRegex::run_program(string_view text, uint32_t* result) const {
+  auto& memory = get_vm_memory();
+  auto slots = group_count_ * 2;
+  memory.current.reset(program_.size(), slots);
+  memory.next.reset(program_.size(), slots);
+  memory.captures.assign(slots, no_position);
+
+  auto add_thread = [&](thread_list& list, uint32_t start, uint32_t position) {
+    auto& stack = memory.stack;
+    auto captures = memory.captures.data();
+    stack.push_back({start, no_position, 0});
+    while (!stack.empty()) {
+      auto frame = stack.back();
+      stack.pop_back();
+      if (frame.slot != no_position) {  // done with everything after a save, put the old value back.
+        captures[frame.slot] = frame.value;
+        continue;
+      }
+      if (list.contains(frame.pc)) continue;
+      auto index = list.size();
+      list.mark(frame.pc);
+      auto& instruction = program_[frame.pc];
+      switch (instruction.op) {
+        case opcode::jump:
+          stack.push_back({instruction.x, no_position, 0});
+          break;
+        case opcode::split:
+          stack.push_back({instruction.y, no_position, 0});
+          stack.push_back({instruction.x, no_position, 0});
+          break;
+        case opcode::save:
+          stack.push_back({0, instruction.x, captures[instruction.x]});
+          captures[instruction.x] = position;
+          stack.push_back({frame.pc + 1, no_position, 0});
+          break;
+        default:
+          copy(captures, captures + slots, list.captures(index));
+      }
+    }
+  };
+
+  add_thread(memory.current, 0, 0);
+  bool matched = false;
+  for (uint32_t position = 0; memory.current.size(); position++) {
+    memory.next.clear();
+    for (size_t index = 0; index < memory.current.size(); index++) {
+      auto& instruction = program_[memory.current[index]];  // the list also holds the jumps it went through.
+      auto captures = memory.current.captures(index);
+      if (instruction.op == opcode::match) {
+        if (position == text.size()) {  // the best match there is, the threads after this one have lower priority.
+          if (result) copy(captures, captures + slots, result);
+          matched = true;
+          break;
+        }
+      } else if (instruction.op == opcode::characters && position < text.size() &&
+                 sets_[instruction.x][static_cast<unsigned char>(text[position])]) {
+        copy(captures, captures + slots, memory.captures.data());
+        add_thread(memory.next, memory.current[index] + 1, position + 1);
+      }
+    }
+    if (matched || position == text.size()) break;
+    swap(memory.current, memory.next);
+  }
+  return matched;
+}
+
+
+optional<PathRegexSet> PathRegexSet::compile(const vector<const PathRegex*>& patterns) {
+  PathRegexSet set;
+  set.size_ = patterns.size();
+  vector<automaton_source> sources;
+  vector<uint32_t> members, wildcards;  // the member each source stands for, members without a pattern.
+  for (uint32_t index = 0; index < patterns.size(); index++) {
+    if (patterns[index]) {
+      sources.push_back({&patterns[index]->program_, &patterns[index]->sets_});
+      members.push_back(index);
+    } else {
+      wildcards.push_back(index);
+    }
+  }
+
+  auto add_matches = [&set](const vector<uint32_t>& matches) {
+    auto first = static_cast<uint32_t>(set.matches_.size());
+    set.matches_.insert(end(set.matches_), begin(matches), end(matches));
+    return make_pair(first, static_cast<uint32_t>(set.matches_.size()));
+  };
+  auto built = build_automaton(sources, max_set_states, set.classes_, set.class_count_, set.transitions_,
+                               [&](const nfa_states& state) {
+    auto matches = wildcards;
+    for (auto entry : state) {
+      auto& instruction = (*sources[entry >> 32].program)[static_cast<uint32_t>(entry)];
+      if (instruction.op == PathRegex::opcode::match) matches.push_back(members[entry >> 32]);
+    }
+    sort(begin(matches), end(matches));
+    set.states_.push_back(add_matches(matches));
+  });
+  if (!built) return nullopt;
+  set.dead_ = add_matches(wildcards);
+  return set;
+}
+
+
+PathRegexSet::matches PathRegexSet::match(string_view text) const noexcept {
+  auto range = &dead_;
+  int32_t state = 0;
+  for (auto character : text) {
+    state = transitions_[state * class_count_ + classes_[static_cast<unsigned char>(character)]];
+    if (state < 0) break;
+  }
+  if (state >= 0) range = &states_[state];
+  return {matches_.data() + range->first, matches_.data() + range->second};
+}
@@ -2,6 +2,14 @@
 // Created by Peyman Mortazavi on 2019-02-13.
 //
 
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <susperia/internal/utility.h>
 
 using namespace std;
@@ -9,25 +17,35 @@ using namespace suspiria::utility;
 
 
 bool string_partitioner::next(string &word) {
-  for(auto index = start_; index < text_.length(); index++) {
-    if (text_[index] == separator_) {
-      if (count_) {
-        word = text_.substr(start_, count_);
-        start_ = index;
-        count_ = 0;
-        return true;
-      } else {
-        start_ = index + 1;
-      }
-    } else {
-      count_++;
-    }
+  string_view view;
+  if (!this->next(view)) return false;
+  word.assign(view);
+  return true;
+}
+
+
+mapped_file::mapped_file(const string& path) {
+  auto fail = [&path]() { throw system_error{errno, generic_category(), "can't map " + path}; };
+  auto file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file < 0) fail();
+  struct stat info{};
+  if (::fstat(file, &info) != 0) {
+    auto error = errno;
+    ::close(file);
+    errno = error;
+    fail();
   }
-  if (count_) {
-    word = text_.substr(start_);  // update the word one last time if there has been any string left.
-    start_ = text_.length();  // this'll make the next run not enter the loop.
-    count_ = 0;  // this'll make the next run not come here again.
-    return true;
+  size_ = static_cast<size_t>(info.st_size);
+  void* data = size_ ? ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0) : nullptr;
+  auto error = errno;
+  ::close(file);  // the mapping keeps the file around.
+  if (data == MAP_FAILED) {
+    errno = error;
+    fail();
   }
-  return false;
-}
\ No newline at end of file
+  data_ = static_cast<const char*>(data);
+}
+
+mapped_file::~mapped_file() {
+  if (data_) ::munmap(const_cast<char*>(data_), size_);
+}
@@ -0,0 +1,679 @@
+//
+// Created by Peyman Mortazavi on 2019-06-04.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <susperia/suspiria.h>
+
+
+using namespace std;
+using namespace suspiria::networking;
+
+
+/**
+ * Echoes whatever it receives and counts the connections it's made for, their reads time out after a while.
+ */
+class echo_protocol : public protocol {
+public:
+  echo_protocol(tcp_connection& connection, atomic<int>& open) : protocol(connection), open_(open) {}
+
+  void connection_made() override {
+    open_++;
+    connection_.set_read_timeout(chrono::seconds(5));
+  }
+
+  void data_received(const char* bytes, size_t length) override {
+    auto& chunk = sent_.emplace_back(bytes, length);
+    connection_.write(asio::buffer(chunk));
+  }
+
+  void data_written(size_t writes) override {
+    for (; writes > 0; writes--) sent_.pop_front();
+  }
+
+  void connection_lost() override { open_--; }
+
+private:
+  atomic<int>& open_;
+  deque<string> sent_;
+};
+
+
+class echo_factory : public protocol_factory {
+public:
+  unique_ptr<protocol> create_protocol(tcp_connection& connection) override {
+    return make_unique<echo_protocol>(connection, open);
+  }
+
+  atomic<int> open{0};
+};
+
+
+/**
+ * Sends the text and waits for it to come back.
+ */
+string echo(asio::ip::tcp::socket& client, const string& text) {
+  asio::write(client, asio::buffer(text));
+  string reply(text.size(), '\0');
+  asio::read(client, asio::buffer(reply));
+  return reply;
+}
+
+
+/**
+ * Answers with the parameters of its route, e.g. "id=12", and counts the requests whose headers it got.
+ */
+class params_delegate : public http_delegate {
+public:
+  void headers_received(HttpRequest&) override { headers++; }
+
+  unique_ptr<HttpResponse> handle(HttpRequest& request) override {
+    auto response = request.make_response();
+    for (auto& param : request.params) {
+      response->body.append(param.name.data(), param.name.size()).append("=");
+      response->body.append(param.value.data(), param.value.size());
+    }
+    return response;
+  }
+
+  atomic<int> headers{0};
+};
+
+
+/**
+ * Reads what the server sends until it closes the connection.
+ */
+string read_all(asio::ip::tcp::socket& client) {
+  string result;
+  asio::error_code error_code;
+  asio::read(client, asio::dynamic_buffer(result), error_code);
+  return result;
+}
+
+
+/**
+ * Sends a request that closes its connection and returns the whole response.
+ */
+string http_exchange(const asio::ip::tcp::endpoint& endpoint, const string& request) {
+  asio::io_context io;
+  asio::ip::tcp::socket client{io};
+  client.connect(endpoint);
+  asio::write(client, asio::buffer(request));
+  return read_all(client);
+}
+
+
+/**
+ * The bytes HttpResponse::write() gathers, in order.
+ */
+string serialize(HttpResponse& response, bool with_body = true) {
+  vector<asio::const_buffer> buffers;
+  response.write(buffers, with_body);
+  string result;
+  for (auto& buffer : buffers) result.append(static_cast<const char*>(buffer.data()), buffer.size());
+  return result;
+}
+
+
+template<typename Condition>
+bool run_until(asio::io_context& io, Condition condition) {
+  for (auto deadline = chrono::steady_clock::now() + chrono::seconds(5); !condition();) {
+    if (chrono::steady_clock::now() > deadline) return false;
+    io.run_one_for(chrono::milliseconds(10));
+  }
+  return true;
+}
+
+
+struct pooled_item : public pool_hook<pooled_item> {
+  explicit pooled_item(int value) : value(value) {}
+  int value;
+};
+
+
+TEST(NetworkingTests, BufferPool) {
+  buffer_pool pool{1024, 2, false};
+  ASSERT_EQ(pool.slab_size(), 1024u);
+  auto first = pool.acquire();
+  auto second = pool.acquire();
+  auto third = pool.acquire();
+  auto first_address = first.get(), third_address = third.get();
+  pool.release(move(first));
+  pool.release(move(third));
+  pool.release(move(second));  // past the idle limit, freed.
+  auto reused = pool.acquire();
+  ASSERT_EQ(reused.get(), third_address);  // the last one returned goes out first, it's likely still in the cache.
+  ASSERT_EQ(pool.acquire().get(), first_address);
+
+  read_size_hint hint{16 * 1024};
+  ASSERT_EQ(hint.size(), 4096u);
+  hint.update(4096);  // filled the window, grows.
+  ASSERT_EQ(hint.size(), 8192u);
+  for (int count = 0; count < 4; count++) hint.update(hint.size());
+  ASSERT_EQ(hint.size(), 16u * 1024);  // up to the slab.
+  hint.update(8192);  // used half of it, stays.
+  ASSERT_EQ(hint.size(), 16u * 1024);
+  for (int count = 0; count < 10; count++) hint.update(10);
+  ASSERT_EQ(hint.size(), read_size_hint::min_read_size);  // shrinks back, but not below the minimum.
+
+  // reads grow and shrink with what comes in, messages bigger than a slab take a few of them.
+  asio::io_context io;
+  auto factory = make_shared<echo_factory>();
+  tcp_server server{io, "127.0.0.1", 0, factory};
+  server.start();
+  thread runner{[&] { server.run(); }};
+  asio::io_context client_io;
+  asio::ip::tcp::socket client{client_io};
+  client.connect(server.local_endpoint());
+  for (size_t size : {10, 40000}) {
+    string message;
+    for (size_t index = 0; message.size() < size; index++) message += static_cast<char>('a' + index % 26);
+    ASSERT_EQ(echo(client, message), message);
+  }
+  server.stop();
+  runner.join();
+}
+
+TEST(NetworkingTests, ConnectionPool) {
+  pool<pooled_item> items{2};
+  auto first = items.create_connection(1);
+  auto second = items.create_connection(2);
+  ASSERT_EQ(items.size(), 2u);
+  ASSERT_EQ(items.create_connection(3), nullptr);  // full.
+  weak_ptr<pooled_item> first_reference = first;
+  first.reset();
+  ASSERT_FALSE(first_reference.expired());  // the pool keeps it alive.
+  items.close_connection(*first_reference.lock());
+  ASSERT_TRUE(first_reference.expired());
+  ASSERT_EQ(items.size(), 1u);
+  items.close_connection(*second);  // closing twice is ignored.
+  items.close_connection(*second);
+  ASSERT_EQ(items.size(), 0u);
+
+  auto third = items.create_connection(3);
+  auto fourth = items.create_connection(4);
+  items.close_all();
+  ASSERT_EQ(items.size(), 0u);
+  items.close_connection(*third);  // no longer in the pool, must not touch it.
+  ASSERT_EQ(items.size(), 0u);
+  ASSERT_NE(items.create_connection(5), nullptr);
+  ASSERT_EQ(items.size(), 1u);
+}
+
+TEST(NetworkingTests, ConnectionPoolCloseAllRace) {
+  for (int round = 0; round < 20; round++) {
+    pool<pooled_item> items;
+    vector<shared_ptr<pooled_item>> held;
+    for (int index = 0; index < 200; index++) held.push_back(items.create_connection(index));
+    atomic<bool> go{false};
+    thread closer{[&] {
+      while (!go) this_thread::yield();
+      for (auto& item : held) items.close_connection(*item);
+    }};
+    go = true;
+    items.close_all();
+    closer.join();
+    ASSERT_EQ(items.size(), 0u) << round;
+    ASSERT_NE(items.create_connection(0), nullptr);
+    ASSERT_EQ(items.size(), 1u);
+  }
+}
+
+TEST(NetworkingTests, Slab) {
+  auto blocks = make_shared<slab>(4, false);
+  slab_allocator<int64_t> allocator{blocks};
+  auto first = allocator.allocate(1);
+  auto second = allocator.allocate(1);
+  ASSERT_NE(first, second);
+  allocator.deallocate(first, 1);
+  ASSERT_EQ(allocator.allocate(1), first);  // freed blocks get reused first.
+  vector<int64_t*> many;
+  for (int index = 0; index < 10; index++) many.push_back(allocator.allocate(1));  // grows past a chunk.
+  for (auto block : many) *block = 42;
+  for (auto block : many) allocator.deallocate(block, 1);
+  auto big = slab_allocator<char>{blocks}.allocate(1024);  // bigger than a block, straight from the heap.
+  slab_allocator<char>{blocks}.deallocate(big, 1024);
+}
+
+TEST(NetworkingTests, ServerTeardownWithLiveConnections) {
+  asio::io_context io;
+  auto factory = make_shared<echo_factory>();
+  asio::ip::tcp::socket client{io};
+  {
+    tcp_server server{io, "127.0.0.1", 0, factory};
+    server.start();
+    client.connect(server.local_endpoint());
+    ASSERT_TRUE(run_until(io, [&] { return factory->open == 1; }));
+    asio::write(client, asio::buffer("ping", 4));
+    ASSERT_TRUE(run_until(io, [&] { return client.available() == 4; }));
+    char reply[4];
+    asio::read(client, asio::buffer(reply));
+    ASSERT_EQ(string(reply, 4), "ping");
+  }  // the connection is still open, its read is pending and its deadline armed on the listener's wheel.
+
+  ASSERT_TRUE(run_until(io, [&] { return factory->open == 0; }));  // closed on its strand after the server is gone.
+  asio::error_code error_code;
+  char byte;
+  client.read_some(asio::buffer(&byte, 1), error_code);
+  ASSERT_EQ(error_code, asio::error::eof);
+  io.restart();
+  io.run_for(chrono::milliseconds(50));  // nothing left to run touches the server.
+}
+
+TEST(NetworkingTests, ServerRunAndStop) {
+  for (size_t threads : {1, 4}) {
+    asio::io_context io;
+    auto factory = make_shared<echo_factory>();
+    tcp_server server{io, "127.0.0.1", 0, factory};
+    server.set_threads(threads);
+    server.start();
+    thread runner{[&] { server.run(); }};
+    asio::io_context client_io;
+    vector<asio::ip::tcp::socket> clients;
+    for (int index = 0; index < 8; index++) {
+      auto& client = clients.emplace_back(client_io);
+      client.connect(server.local_endpoint());
+      ASSERT_EQ(echo(client, "hello " + to_string(index)), "hello " + to_string(index));
+    }
+    server.stop();  // from another thread than the ones running the server.
+    runner.join();  // closing every connection leaves nothing to run.
+    ASSERT_EQ(factory->open, 0) << threads;
+    for (auto& client : clients) {
+      asio::error_code error_code;
+      char byte;
+      client.read_some(asio::buffer(&byte, 1), error_code);
+      ASSERT_EQ(error_code, asio::error::eof);
+    }
+  }
+}
+
+TEST(NetworkingTests, ShardedServer) {
+  asio::io_context io;
+  auto factory = make_shared<echo_factory>();
+  tcp_server server{io, "127.0.0.1", 0, factory};
+  server.start(2);
+  thread runner{[&] { server.run(); }};
+  asio::io_context client_io;
+  vector<asio::ip::tcp::socket> clients;
+  for (int index = 0; index < 3; index++) {
+    auto& client = clients.emplace_back(client_io);
+    client.connect(server.local_endpoint());  // every worker listens on the same port.
+    ASSERT_EQ(echo(client, "worker"), "worker");
+  }
+  server.stop();
+  runner.join();
+  ASSERT_EQ(factory->open, 0);
+}
+
+TEST(NetworkingTests, RoutingDelegate) {
+  auto items = make_shared<params_delegate>();
+  auto first = make_shared<GraphRouter<http_delegate>>();
+  first->add_route(GET, "/items/<int:id>", items);
+  first->add_route(PUT, "/items/<int:id>", items);
+  auto holder = make_shared<RouterHolder<http_delegate>>(move(first));
+  auto hosts = make_shared<HostRouter<http_delegate>>();
+  hosts->set_default(holder);
+
+  asio::io_context io;
+  http_server server{io, "127.0.0.1", 0, make_shared<routing_delegate>(hosts)};
+  server.start();
+  thread runner{[&] { server.run(); }};
+  auto endpoint = server.local_endpoint();
+
+  auto response = http_exchange(endpoint, "GET /items/7?full HTTP/1.1\r\nConnection: close\r\n\r\n");
+  ASSERT_EQ(response.substr(0, 15), "HTTP/1.1 200 OK");
+  ASSERT_EQ(response.substr(response.size() - 4), "id=7");
+  response = http_exchange(endpoint, "OPTIONS /items/7 HTTP/1.1\r\nConnection: close\r\n\r\n");
+  ASSERT_EQ(response.substr(0, 15), "HTTP/1.1 200 OK");
+  ASSERT_NE(response.find("Allow: GET, PUT\r\n"), string::npos);
+  response = http_exchange(endpoint, "POST /items/7 HTTP/1.1\r\nConnection: close\r\n\r\n");
+  ASSERT_EQ(response.substr(0, 12), "HTTP/1.1 405");
+  ASSERT_NE(response.find("Allow: GET, PUT\r\n"), string::npos);
+  response = http_exchange(endpoint, "GET /users HTTP/1.1\r\nConnection: close\r\n\r\n");
+  ASSERT_EQ(response.substr(0, 12), "HTTP/1.1 404");
+
+  // a request resolved before a publish gets handled after it, with the names of its params still there.
+  asio::io_context client_io;
+  asio::ip::tcp::socket pending{client_io};
+  pending.connect(endpoint);
+  string headers = "PUT /items/12 HTTP/1.1\r\nContent-Length: 2\r\nConnection: close\r\n\r\n";
+  asio::write(pending, asio::buffer(headers));
+  auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+  while (items->headers < 2 && chrono::steady_clock::now() < deadline) this_thread::sleep_for(chrono::milliseconds(1));
+  ASSERT_EQ(items->headers, 2);
+  auto next = make_shared<GraphRouter<http_delegate>>();
+  next->add_route(GET, "/others/<int:other>", items);
+  holder->publish(move(next));
+  // resolving again lets the server's thread drop the table it cached, the pending request is the last one on it.
+  response = http_exchange(endpoint, "GET /items/7 HTTP/1.1\r\nConnection: close\r\n\r\n");
+  ASSERT_EQ(response.substr(0, 12), "HTTP/1.1 404");
+  asio::write(pending, asio::buffer("ok", 2));
+  response = read_all(pending);
+  ASSERT_EQ(response.substr(0, 15), "HTTP/1.1 200 OK");
+  ASSERT_EQ(response.substr(response.size() - 5), "id=12");
+
+  server.stop();
+  runner.join();
+}
+
+TEST(NetworkingTests, ResponseWrite) {
+  HttpResponse response;
+  response.headers["Content-Type"] = "text/plain";
+  response.body = "hello";
+  vector<asio::const_buffer> buffers;
+  response.write(buffers);
+  ASSERT_EQ(buffers.size(), 8u);  // every piece is a buffer of its own, nothing gets copied but the length.
+  ASSERT_EQ(serialize(response), "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nhello");
+  ASSERT_EQ(serialize(response, false), "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\n");
+
+  HttpResponse sized;
+  sized.status = HttpStatus::NotFound;
+  sized.headers["content-length"] = "3";  // set by the handler, whatever its case, so it isn't added again.
+  sized.body = "abc";
+  ASSERT_EQ(serialize(sized), "HTTP/1.1 404 Not Found\r\ncontent-length: 3\r\n\r\nabc");
+  sized.status = static_cast<HttpStatus>(418);  // not one HttpStatus names, written out from its code.
+  ASSERT_EQ(serialize(sized), "HTTP/1.1 418 \r\ncontent-length: 3\r\n\r\nabc");
+
+  asio::io_context io;
+  http_server server{io, "127.0.0.1", 0, [](HttpRequest& request) {
+    auto result = request.make_response();
+    result->body = "hello";
+    return result;
+  }};
+  server.start();
+  thread runner{[&] { server.run(); }};
+  auto reply = http_exchange(server.local_endpoint(), "HEAD / HTTP/1.1\r\nConnection: close\r\n\r\n");
+  ASSERT_EQ(reply, "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n");
+  server.stop();
+  runner.join();
+}
+
+TEST(NetworkingTests, RequestBodyInArena) {
+  asio::io_context io;
+  http_server server{io, "127.0.0.1", 0, [](HttpRequest& request) {
+    auto response = request.make_response();
+    auto& resource = static_cast<body_resource&>(*request.body.get_allocator().resource());
+    response->body = resource.arena() == request.resource() ? "arena:" : "heap:";
+    response->body += request.body;
+    return response;
+  }};
+  server.start();
+  thread runner{[&] { server.run(); }};
+  asio::io_context client_io;
+  asio::ip::tcp::socket client{client_io};
+  client.connect(server.local_endpoint());
+  for (string body : {"first", "second body"}) {  // the body starts over in the arena of every request.
+    auto head = "POST / HTTP/1.1\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n";
+    asio::write(client, asio::buffer(head + body.substr(0, 3)));
+    this_thread::sleep_for(chrono::milliseconds(5));  // the rest of the body comes in another read.
+    asio::write(client, asio::buffer(body.substr(3)));
+    auto expected = "HTTP/1.1 200 OK\r\nContent-Length: " + to_string(body.size() + 6) + "\r\n\r\narena:" + body;
+    string reply(expected.size(), '\0');
+    asio::read(client, asio::buffer(reply));
+    ASSERT_EQ(reply, expected);
+  }
+  server.stop();
+  runner.join();
+}
+
+TEST(NetworkingTests, Pipelining) {
+  asio::io_context io;
+  atomic<int> handled{0};
+  http_server server{io, "127.0.0.1", 0, [&handled](HttpRequest& request) {
+    handled++;
+    auto response = request.make_response();
+    if (request.uri == "/big") {
+      response->body.assign(4 * 1024 * 1024, 'x');  // takes many writes, the connection has to wait for all of them.
+    } else if (request.uri == "/64k") {
+      response->body.assign(64 * 1024, 'x');
+    } else {
+      response->body.assign(request.uri.data(), request.uri.size());
+    }
+    return response;
+  }};
+  server.start();
+  thread runner{[&] { server.run(); }};
+  auto endpoint = server.local_endpoint();
+  auto response = [](const string& body) {
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+  };
+
+  // answered in order, in one go, up to the request that closes the connection: whatever follows it is dropped.
+  auto replies = http_exchange(endpoint, "GET /1 HTTP/1.1\r\n\r\nGET /2 HTTP/1.1\r\n\r\n"
+                                         "GET /3 HTTP/1.1\r\nConnection: close\r\n\r\nGET /4 HTTP/1.1\r\n\r\n");
+  ASSERT_EQ(replies, response("/1") + response("/2") + response("/3"));
+  // a malformed request ends the connection once the responses before it are sent.
+  replies = http_exchange(endpoint, "GET /1 HTTP/1.1\r\n\r\nnot http at all\r\n\r\n");
+  ASSERT_EQ(replies, response("/1"));
+  replies = http_exchange(endpoint, "GET /big HTTP/1.1\r\nConnection: close\r\n\r\n");
+  ASSERT_EQ(replies, response(string(4 * 1024 * 1024, 'x')));
+
+  // requests get parsed only as fast as the client takes their responses.
+  asio::io_context client_io;
+  asio::ip::tcp::socket client{client_io};
+  client.open(asio::ip::tcp::v4());
+  client.set_option(asio::socket_base::receive_buffer_size(8192));
+  client.connect(endpoint);
+  string requests;
+  for (int index = 0; index < 199; index++) requests += "GET /64k HTTP/1.1\r\n\r\n";
+  requests += "GET /64k HTTP/1.1\r\nConnection: close\r\n\r\n";
+  handled = 0;
+  asio::write(client, asio::buffer(requests));
+  this_thread::sleep_for(chrono::milliseconds(100));
+  ASSERT_LT(handled, 100);  // about a MiB waits to be sent, and whatever the socket buffers hold.
+  string expected;
+  for (int index = 0; index < 200; index++) expected += response(string(64 * 1024, 'x'));
+  ASSERT_EQ(read_all(client), expected);
+  ASSERT_EQ(handled, 200);
+
+  server.stop();
+  runner.join();
+}
+
+TEST(NetworkingTests, HttpHeaders) {
+  HttpHeaders headers;
+  headers.add("Content-Type", "text/plain");
+  headers.add("X-Tag", "first");
+  headers.add("x-tag", "second");
+  ASSERT_EQ(headers.size(), 3u);
+  ASSERT_EQ(headers["content-type"], "text/plain");  // names are compared without their case.
+  ASSERT_EQ(headers["CONTENT-TYPE"], "text/plain");
+  ASSERT_EQ(headers["X-TAG"], "first");  // the first one of a repeated header.
+  ASSERT_TRUE(headers.contains("x-Tag"));
+  ASSERT_FALSE(headers.contains("Content"));
+  ASSERT_EQ(headers.get("Accept", "*/*"), "*/*");
+  headers.clear();
+  ASSERT_TRUE(headers.empty());
+
+  // a request trickling in over many reads: the views into each read get copied before the read buffer goes back.
+  asio::io_context io;
+  http_server server{io, "127.0.0.1", 0, [](HttpRequest& request) {
+    auto response = request.make_response();
+    response->body.assign(request.uri.data(), request.uri.size());
+    for (auto& header : request.headers) {
+      response->body.append(" ").append(header.name.data(), header.name.size());
+      response->body.append("=").append(header.value.data(), header.value.size());
+    }
+    return response;
+  }};
+  server.start();
+  thread runner{[&] { server.run(); }};
+  asio::io_context client_io;
+  asio::ip::tcp::socket client{client_io};
+  client.connect(server.local_endpoint());
+  client.set_option(asio::ip::tcp::no_delay(true));
+  string request = "GET /some/long/path?with=query HTTP/1.1\r\nX-First-Header: first value\r\n"
+                   "Connection: close\r\nX-Last: last value\r\n\r\n";
+  for (size_t position = 0; position < request.size(); position += 7) {
+    asio::write(client, asio::buffer(request.substr(position, 7)));  // splits names and values alike.
+    this_thread::sleep_for(chrono::milliseconds(1));
+  }
+  auto body = "/some/long/path?with=query X-First-Header=first value Connection=close X-Last=last value"s;
+  ASSERT_EQ(read_all(client), "HTTP/1.1 200 OK\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n" + body);
+  server.stop();
+  runner.join();
+}
+
+/**
+ * Streams the bodies of uploads and answers with what it got, buffers the others.
+ */
+class upload_delegate : public http_delegate {
+public:
+  void headers_received(HttpRequest& request) override {
+    received_ = 0;
+    if (request.uri != "/upload") return;
+    request.stream_body([this](string_view chunk) {
+      received_ += chunk.size();
+      valid_ = valid_ && all_of(begin(chunk), end(chunk), [](char character) { return character == 'u'; });
+    });
+  }
+
+  unique_ptr<HttpResponse> handle(HttpRequest& request) override {
+    auto response = request.make_response();
+    response->body = request.is_body_streamed() ? "streamed " + to_string(received_) : "buffered ";
+    if (!request.is_body_streamed()) response->body += request.body;
+    if (!valid_) response->status = HttpStatus::BadRequest;
+    return response;
+  }
+
+private:
+  size_t received_ = 0;
+  bool valid_ = true;
+};
+
+
+TEST(NetworkingTests, StreamedBody) {
+  asio::io_context io;
+  http_server server{io, "127.0.0.1", 0, make_shared<upload_delegate>()};
+  server.set_limits({1024});
+  server.start();
+  thread runner{[&] { server.run(); }};
+  string upload(256 * 1024, 'u');  // many reads worth, none of it kept in the request.
+  auto replies = http_exchange(server.local_endpoint(),
+                               "POST /upload HTTP/1.1\r\nContent-Length: " + to_string(upload.size()) + "\r\n\r\n" +
+                               upload + "POST /other HTTP/1.1\r\nContent-Length: 4\r\nConnection: close\r\n\r\nbody");
+  ASSERT_EQ(replies, "HTTP/1.1 200 OK\r\nContent-Length: 15\r\n\r\nstreamed 262144"
+                     "HTTP/1.1 200 OK\r\nContent-Length: 13\r\n\r\nbuffered body");
+
+  // a buffered body over the limit is turned down, whether its length is known up front or not.
+  auto too_large = "HTTP/1.1 413 Payload Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n"s;
+  replies = http_exchange(server.local_endpoint(), "POST /other HTTP/1.1\r\nContent-Length: 2048\r\n\r\n");
+  ASSERT_EQ(replies, too_large);
+  replies = http_exchange(server.local_endpoint(),
+                          "POST /other HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n800\r\n" + string(2048, 'b'));
+  ASSERT_EQ(replies, too_large);
+  server.stop();
+  runner.join();
+}
+
+TEST(NetworkingTests, BodyResource) {
+  char buffer[body_resource::heap_threshold * 2];
+  pmr::monotonic_buffer_resource arena{buffer, sizeof(buffer), pmr::null_memory_resource()};
+  body_resource resource;
+  resource.set_arena(&arena);
+  pmr::string body{&resource};
+  body.assign(100, 's');  // small bodies stay in the arena.
+  ASSERT_TRUE(body.data() >= buffer && body.data() < buffer + sizeof(buffer));
+  body.assign(body_resource::heap_threshold * 4, 'l');  // would not fit, the arena has nothing to fall back on.
+  ASSERT_FALSE(body.data() >= buffer && body.data() < buffer + sizeof(buffer));
+}
+
+/**
+ * Remembers when it expired.
+ */
+class recorded_timer : public timer_wheel::timer {
+public:
+  int fired = 0;
+  timer_wheel::clock::time_point fired_at;
+
+protected:
+  void expired() override {
+    fired++;
+    fired_at = timer_wheel::clock::now();
+  }
+};
+
+
+TEST(NetworkingTests, TimerWheel) {
+  using chrono::milliseconds;
+  asio::io_context io;
+  auto wheel = make_shared<timer_wheel>(io, false, milliseconds(5), 8);  // a turn takes 40ms.
+  recorded_timer soon, later, cancelled, rearmed;
+  auto start = timer_wheel::clock::now();
+  wheel->start();
+  wheel->schedule(soon, milliseconds(20));
+  wheel->schedule(later, milliseconds(90));  // a couple of turns away.
+  wheel->schedule(cancelled, milliseconds(10));
+  wheel->cancel(cancelled);
+  wheel->schedule(rearmed, milliseconds(10));
+  wheel->schedule(rearmed, milliseconds(60));  // the new deadline replaces the old one.
+  ASSERT_TRUE(run_until(io, [&] { return later.fired > 0; }));
+  wheel->stop();
+  io.run();  // the stopped tick was the last thing holding on to the wheel.
+  wheel.reset();
+
+  ASSERT_EQ(soon.fired, 1);
+  ASSERT_EQ(later.fired, 1);
+  ASSERT_EQ(rearmed.fired, 1);
+  ASSERT_EQ(cancelled.fired, 0);
+  ASSERT_GE(soon.fired_at - start, milliseconds(20));
+  ASSERT_GE(rearmed.fired_at - start, milliseconds(60));
+  ASSERT_GE(later.fired_at - start, milliseconds(90));
+  ASSERT_LT(soon.fired_at, rearmed.fired_at);
+  ASSERT_LT(rearmed.fired_at, later.fired_at);
+}
+
+
+TEST(NetworkingTests, HttpTimeouts) {
+  using chrono::milliseconds;
+  asio::io_context io;
+  http_server server{io, "127.0.0.1", 0, [](HttpRequest& request) {
+    auto response = request.make_response();
+    if (request.uri == "/big") response->body.assign(16 * 1024 * 1024, 'x');  // more than the socket buffers hold.
+    return response;
+  }};
+  http_timeouts timeouts;
+  timeouts.keep_alive = timeouts.request_header = timeouts.body = timeouts.write = milliseconds(50);
+  server.set_timeouts(timeouts);
+  server.start();
+  thread runner{[&] { server.run(); }};
+  auto start = chrono::steady_clock::now();
+
+  asio::io_context client_io;
+  asio::ip::tcp::socket idle{client_io}, partial{client_io}, stalled{client_io}, kept{client_io}, slow{client_io};
+  slow.open(asio::ip::tcp::v4());
+  slow.set_option(asio::socket_base::receive_buffer_size(8192));
+  for (auto client : {&idle, &partial, &stalled, &kept, &slow}) client->connect(server.local_endpoint());
+  asio::write(partial, asio::buffer(string{"GET / HTTP/1.1\r\nX-Never: end"}));  // headers never finish.
+  asio::write(stalled, asio::buffer(string{"POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\nabc"}));  // nor the body.
+  asio::write(kept, asio::buffer(string{"GET / HTTP/1.1\r\n\r\n"}));
+  auto answer = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"s;
+  string reply(answer.size(), '\0');
+  asio::read(kept, asio::buffer(reply));  // answered, then idle with the connection kept alive.
+  ASSERT_EQ(reply, answer);
+  asio::write(slow, asio::buffer(string{"GET /big HTTP/1.1\r\n\r\n"}));  // and never reads the answer.
+
+  // each of them gets closed after its timeout, a tick of the wheel late at most.
+  for (auto client : {&idle, &partial, &stalled, &kept}) {
+    char byte;
+    asio::error_code error_code;
+    client->read_some(asio::buffer(&byte, 1), error_code);
+    ASSERT_EQ(error_code, asio::error::eof);
+  }
+  ASSERT_GE(chrono::steady_clock::now() - start, milliseconds(50));
+  this_thread::sleep_for(milliseconds(150));  // its write started around the same time as the others.
+  ASSERT_LT(read_all(slow).size(), 16u * 1024 * 1024);  // cut short.
+  ASSERT_LT(chrono::steady_clock::now() - start, chrono::seconds(5));
+  server.stop();
+  runner.join();
+}
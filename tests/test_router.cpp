@@ -2,7 +2,14 @@
 // Created by Peyman Mortazavi on 2019-02-17.
 //
 
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <regex>
+#include <sstream>
+#include <system_error>
 
 #include <gtest/gtest.h>
 
@@ -88,4 +95,610 @@ TEST_F(Networking_RouterTests, AddRouteWithNode) {
   assert_has_handler(router->resolve("/conflict/regular_node/"), 3);
   assert_has_handler(router->resolve("/conflict/some_random_thing/"), 2);
   assert_has_handler(router->resolve("/conflict/23/"), 5);
-}
\ No newline at end of file
+}
+
+TEST_F(Networking_RouterTests, FrozenRouter) {
+  router->add_route("", make_shared<int>(1));
+  router->add_route("/api/v1/users", make_shared<int>(2));
+  router->add_route("/api/v1/users/<:id>", make_shared<int>(3));
+  router->add_route("/api/v1/users/<:id>/friends/<re:(\\d*)-(\\d*):start:end>", make_shared<int>(4));
+  router->add_route("/api/v1/users/me", make_shared<int>(5));
+  router->add_route("//api///v2/", make_shared<int>(6));
+  auto shared_node = make_shared<RouterNode<int>>();  // reachable from two parents, should be frozen only once.
+  shared_node->handler = make_shared<int>(7);
+  router->add_route("/a", make_shared<int>(8)).add_node("shared", shared_node);
+  router->add_route("/b", make_shared<int>(9)).add_node("shared", shared_node);
+
+  auto frozen = router->freeze();
+  ASSERT_EQ(frozen.size(), 12);
+  for (auto& path : {"/", "/api/v1/users", "/api/v1/users/", "/api/v1/users/12", "/api/v1/users/me",
+                     "/api/v1/users/12/friends/10-20", "/api/v1/users/12/friends/x", "/api/v2", "/api", "/nothing",
+                     "/a/shared", "/b/shared/", "/b", "/c/shared"}) {
+    auto expected = router->resolve(path);
+    auto result = frozen.resolve(path);
+    ASSERT_EQ(result.matched, expected.matched) << path;
+    ASSERT_EQ(result.handler, expected.handler) << path;
+    ASSERT_EQ(result.params, expected.params) << path;
+  }
+  auto result = frozen.resolve("/api/v1/users/12/friends/10-20");
+  assert_has_handler(result, 4);
+  ASSERT_EQ(result.params["id"], "12");
+  ASSERT_EQ(result.params["start"], "10");
+  ASSERT_EQ(result.params["end"], "20");
+}
+
+TEST_F(Networking_RouterTests, RouteParams) {
+  router->add_route("/<:a>/<:b>/<:c>/<:d>/<:e>/<:a>", make_shared<int>(1));
+  router->add_route("/files/<re:(\\w*)-(\\w*):name:extension>", make_shared<int>(2));
+
+  auto result = router->resolve("/1/2/3/4/5/6");  // outgrows the inline params, a is set twice.
+  assert_has_handler(result, 1);
+  ASSERT_EQ(result.params.size(), 5);
+  ASSERT_EQ(result.params["a"], "6");
+  ASSERT_EQ(result.params["e"], "5");
+  ASSERT_FALSE(result.params.contains("f"));
+  ASSERT_EQ(result.params.get("f", "none"), "none");
+
+  result = router->resolve("/files/report-pdf");
+  assert_has_handler(result, 2);
+  vector<pair<string_view, string_view>> params;
+  for (auto& param : result.params) params.emplace_back(param.name, param.value);
+  ASSERT_EQ(params, (vector<pair<string_view, string_view>>{{"name", "report"}, {"extension", "pdf"}}));
+}
+
+TEST_F(Networking_RouterTests, TypedMatchers) {
+  router->add_route("/users/<int:id>", make_shared<int>(1));
+  router->add_route("/orders/<uint:id>", make_shared<int>(2));
+  router->add_route("/sessions/<uuid:id>", make_shared<int>(3));
+  router->add_route("/posts/<slug:name>", make_shared<int>(4));
+  router->add_route("/colors/<hex:value>", make_shared<int>(5));
+
+  auto result = router->resolve("/users/-42");
+  assert_has_handler(result, 1);
+  ASSERT_EQ(result.params["id"], "-42");
+  ASSERT_EQ(result.params.get_as<int64_t>("id"), -42);
+  ASSERT_EQ(result.params.get_as<uint64_t>("id"), nullopt);
+  ASSERT_FALSE(router->resolve("/users/4x2").matched);
+  ASSERT_FALSE(router->resolve("/users/+42").matched);
+  ASSERT_FALSE(router->resolve("/users/9223372036854775808").matched);  // overflows an int64.
+
+  result = router->resolve("/orders/18446744073709551615");
+  assert_has_handler(result, 2);
+  ASSERT_EQ(result.params.get_as<uint64_t>("id"), 18446744073709551615ull);
+  ASSERT_FALSE(router->resolve("/orders/-1").matched);
+
+  result = router->resolve("/sessions/123e4567-E89B-12d3-a456-426614174000");
+  assert_has_handler(result, 3);
+  Uuid expected{0x12, 0x3e, 0x45, 0x67, 0xe8, 0x9b, 0x12, 0xd3, 0xa4, 0x56, 0x42, 0x66, 0x14, 0x17, 0x40, 0x00};
+  ASSERT_EQ(result.params.get_as<Uuid>("id"), expected);
+  ASSERT_FALSE(router->resolve("/sessions/123e4567-e89b-12d3-a456-42661417400").matched);
+  ASSERT_FALSE(router->resolve("/sessions/123e4567-e89b-12d3-a456_426614174000").matched);
+  ASSERT_FALSE(router->resolve("/sessions/123e4567-e89b-12d3-a456-42661417400g").matched);
+
+  assert_has_handler(router->resolve("/posts/hello-world_2"), 4);
+  ASSERT_FALSE(router->resolve("/posts/hello.world").matched);
+
+  result = router->resolve("/colors/Ff00aA");
+  assert_has_handler(result, 5);
+  ASSERT_EQ(result.params.get_as<uint64_t>("value"), 0xff00aa);
+  result = router->resolve("/colors/0123456789abcdef0");  // too long to parse, still a match.
+  assert_has_handler(result, 5);
+  ASSERT_EQ(result.params.get_as<uint64_t>("value"), nullopt);
+  ASSERT_FALSE(router->resolve("/colors/ff00ag").matched);
+}
+
+TEST_F(Networking_RouterTests, PathRegex) {
+  vector<string> patterns{
+    R"(\d+)", R"((\w+)-(\d*))", R"(^[a-f\d]{2,4}$)", R"((a|ab)(c|bcd)(d*))", R"((a*)(a*?)b)", R"([^/]+\.json)",
+    R"((?:v(\d+))?api)", R"(\s*\S+)", R"(([a-z]+)|([0-9]+))", R"((x{2,})(x{1,2}?))", R"(.*?(\d+)\.(\w{1,3}))",
+  };
+  vector<string> inputs{
+    "", "a", "ab", "abcd", "abcdd", "aab", "b", "12", "123", "1f", "abcde", "users-42", "users-", "-1", "api", "v2api",
+    "vapi", "data.json", "data.json.json", "  x", " ", "xxx", "xxxxx", "file12.txt", "a1.b", "a/b", "\n",
+  };
+  for (auto& pattern : patterns) {
+    auto compiled = PathRegex::compile(pattern);
+    ASSERT_TRUE(compiled) << pattern;
+    regex expected{pattern, regex_constants::ECMAScript};
+    for (auto& input : inputs) {
+      smatch results;
+      auto matched = regex_match(input, results, expected);
+      vector<string> groups;
+      ASSERT_EQ(compiled->match(input, [&](size_t, string_view value) { groups.emplace_back(value); }), matched)
+        << pattern << " on " << input;
+      if (!matched) continue;
+      ASSERT_EQ(groups.size(), results.size() - 1);
+      for (size_t index = 0; index < groups.size(); index++) {
+        ASSERT_EQ(groups[index], results[index + 1].str()) << pattern << " on " << input;
+      }
+    }
+  }
+
+  // left to std::regex.
+  ASSERT_FALSE(PathRegex::compile(R"((a)\1)"));
+  ASSERT_FALSE(PathRegex::compile(R"(a(?=b))"));
+  ASSERT_FALSE(PathRegex::compile(R"(\bword)"));
+  ASSERT_FALSE(PathRegex::compile("(a"));
+
+  ASSERT_TRUE(PathRegex::compile(R"(a\d*)")->disjoint(*PathRegex::compile(R"(b\w*)")));
+  ASSERT_TRUE(PathRegex::compile(R"(\d+)")->disjoint(*PathRegex::compile("[a-z]+")));
+  ASSERT_FALSE(PathRegex::compile(R"(\d+)")->disjoint(*PathRegex::compile(R"(\w+)")));
+  ASSERT_FALSE(PathRegex::compile("x*")->disjoint(*PathRegex::compile("y*")));  // both match the empty text.
+
+  router->add_route("/files/<re:(\\w*)-(\\d*):name:year>", make_shared<int>(1));
+  auto result = router->resolve("/files/report-2019");
+  assert_has_handler(result, 1);
+  ASSERT_EQ(result.params["name"], "report");
+  ASSERT_EQ(result.params["year"], "2019");
+  ASSERT_FALSE(router->resolve("/files/report-x").matched);
+}
+
+TEST_F(Networking_RouterTests, DynamicSiblings) {
+  router->add_route("/v/<re:a\\w*:x>", make_shared<int>(1));
+  router->add_route("/v/<int:id>", make_shared<int>(2));
+  router->add_route("/v/<hex:value>", make_shared<int>(3));
+  router->add_route("/v/<:any>", make_shared<int>(4));
+  router->add_route("/v/<re:(\\d*)-(\\d*):start:end>", make_shared<int>(5));
+  ASSERT_TRUE(router->get_root().get_static_node("v")->get_dynamic_set());
+
+  auto frozen = router->freeze();
+  for (auto& path : {"/v/abc", "/v/12", "/v/99999999999999999999", "/v/ff", "/v/zz", "/v/1-2"}) {
+    auto expected = router->resolve(path);
+    auto result = frozen.resolve(path);
+    ASSERT_EQ(result.matched, expected.matched) << path;
+    ASSERT_EQ(result.handler, expected.handler) << path;
+    ASSERT_EQ(result.params, expected.params) << path;
+  }
+
+  assert_has_handler(router->resolve("/v/abc"), 1);  // a hex number too, the first sibling wins.
+  assert_has_handler(router->resolve("/v/12"), 2);
+  auto result = router->resolve("/v/99999999999999999999");  // fits the pattern of int but overflows.
+  assert_has_handler(result, 3);
+  ASSERT_EQ(result.params.get_as<uint64_t>("value"), nullopt);
+  assert_has_handler(router->resolve("/v/ff"), 3);
+  assert_has_handler(router->resolve("/v/zz"), 4);
+  assert_has_handler(router->resolve("/v/1-2"), 4);
+}
+
+TEST_F(Networking_RouterTests, MethodRouting) {
+  router->add_route(GET, "/users/<int:id>", make_shared<int>(1));
+  router->add_route(PUT, "/users/<int:id>", make_shared<int>(2));
+  router->add_route("/files", make_shared<int>(3));
+  router->add_route(POST, "/files", make_shared<int>(4));
+  ASSERT_THROW(router->add_route(static_cast<HttpMethod>(9), "/users", make_shared<int>(5)), invalid_argument);
+
+  auto frozen = router->freeze();
+  vector<const Router<int>*> routers{router.get(), &frozen};
+  for (auto current : routers) {
+    auto result = current->resolve(GET, "/users/12");
+    assert_has_handler(result, 1);
+    ASSERT_EQ(result.params["id"], "12");
+    assert_has_handler(current->resolve(PUT, "/users/12"), 2);
+
+    result = current->resolve(DELETE, "/users/12");  // 405
+    ASSERT_FALSE(result.matched);
+    ASSERT_TRUE(result.method_not_allowed());
+    ASSERT_EQ(result.allowed.to_string(), "GET, PUT");
+    ASSERT_FALSE(current->resolve("/users/12").matched);  // no handler for every method.
+
+    result = current->resolve(GET, "/users/abc");  // 404
+    ASSERT_FALSE(result.matched);
+    ASSERT_FALSE(result.method_not_allowed());
+
+    assert_has_handler(current->resolve(POST, "/files"), 4);
+    assert_has_handler(current->resolve(OPTIONS, "/files"), 3);
+    assert_has_handler(current->resolve("/files"), 3);
+    ASSERT_EQ(current->resolve(GET, "/files").allowed, HttpMethods::all());
+  }
+}
+
+TEST_F(Networking_RouterTests, CachedRouter) {
+  router->add_route(GET, "/users/<int:id>/<re:(\\w*)-(\\w*):name:extension>", make_shared<int>(1));
+  router->add_route("/files/<:name>", make_shared<int>(2));
+  CachedRouter<int> cache{*router, 16};
+
+  for (auto pass = 0; pass < 2; pass++) {  // a miss, then a hit.
+    auto result = cache.resolve(GET, "/users/12/report-pdf");
+    auto expected = router->resolve(GET, "/users/12/report-pdf");
+    assert_has_handler(result, 1);
+    ASSERT_EQ(result.params, expected.params);
+    ASSERT_EQ(result.params.get_as<int64_t>("id"), 12);
+    ASSERT_EQ(result.params["extension"], "pdf");
+
+    result = cache.resolve(DELETE, "/users/12/report-pdf");
+    ASSERT_TRUE(result.method_not_allowed());
+    ASSERT_FALSE(cache.resolve("/users/12/report-pdf").matched);
+    ASSERT_FALSE(cache.resolve("/nothing").matched);
+  }
+
+  // values point into the path that was resolved, not into the one that filled the cache.
+  string path{"/files/a"};
+  auto result = cache.resolve(path);
+  ASSERT_EQ(result.params["name"], "a");
+  string other{path};
+  result = cache.resolve(other);
+  ASSERT_EQ(result.params["name"].data(), other.data() + 7);
+
+  // adding routes invalidates the cache.
+  router->add_route("/files/<:name>", make_shared<int>(3));
+  assert_has_handler(cache.resolve(path), 3);
+}
+
+TEST_F(Networking_RouterTests, RouterHolder) {
+  router->add_route("/users/<:name>", make_shared<int>(1));
+  auto first = make_shared<FrozenRouter<int>>(router->freeze());
+  weak_ptr<FrozenRouter<int>> first_reference = first;
+  RouterHolder<int> holder{move(first)};
+  assert_has_handler(holder.resolve("/users/peyman"), 1);
+  auto version = holder.version();
+
+  auto next = make_shared<GraphRouter<int>>();
+  next->add_route("/users/<:name>", make_shared<int>(2));
+  next->add_route(GET, "/teams", make_shared<int>(3));
+  auto in_flight = holder.snapshot();
+  holder.publish(next);
+  ASSERT_GT(holder.version(), version);
+  assert_has_handler(in_flight->resolve("/users/peyman"), 1);  // requests in flight keep their table.
+  assert_has_handler(holder.resolve("/users/peyman"), 2);
+  assert_has_handler(holder.resolve(GET, "/teams"), 3);
+
+  ASSERT_FALSE(first_reference.expired());
+  in_flight.reset();
+  ASSERT_TRUE(first_reference.expired());  // reclaimed once the last request lets go of it.
+  ASSERT_THROW(holder.publish(nullptr), invalid_argument);
+}
+
+TEST_F(Networking_RouterTests, PathMatcher) {
+  router->add_route("/static/<path:file>", make_shared<int>(1));
+  router->add_route("/static/favicon", make_shared<int>(2));
+  router->add_route("/static", make_shared<int>(3));
+  router->add_route("/proxy/<int:port>/<path:rest>", make_shared<int>(4));
+  ASSERT_THROW(router->add_route("/files/<path:rest>/edit", make_shared<int>(5)), invalid_argument);
+
+  auto frozen = router->freeze();
+  vector<const Router<int>*> routers{router.get(), &frozen};
+  for (auto current : routers) {
+    auto result = current->resolve("/static/css/site/main.css");
+    assert_has_handler(result, 1);
+    ASSERT_EQ(result.params["file"], "css/site/main.css");
+    ASSERT_EQ(current->resolve("/static/a//b/").params["file"], "a//b/");  // the rest as it is.
+    assert_has_handler(current->resolve("/static/favicon"), 2);  // static children come first.
+    ASSERT_FALSE(current->resolve("/static/favicon/other").matched);  // no backtracking out of a static child.
+    assert_has_handler(current->resolve("/static/"), 3);
+
+    result = current->resolve("/proxy/8080/api/v1/users");
+    assert_has_handler(result, 4);
+    ASSERT_EQ(result.params.get_as<int64_t>("port"), 8080);
+    ASSERT_EQ(result.params["rest"], "api/v1/users");
+    ASSERT_FALSE(current->resolve("/proxy/http/api").matched);
+  }
+}
+
+TEST_F(Networking_RouterTests, AdaptiveOrder) {
+  // siblings too complex to share an automaton, each one matching segments of its own but the last two.
+  router->set_adaptive(true);
+  auto& root = router->get_root();
+  auto add_sibling = [&root](const string& pattern, int handler) {
+    auto node = make_shared<RouterNode<int>>();
+    node->handler = make_shared<int>(handler);
+    root.add_node(hash<string>()(pattern), make_shared<RegexRouteMatcher>(pattern, vector<string>{}), node, false);
+  };
+  string prefixes = "cdefghijk";
+  for (size_t index = 0; index < prefixes.size(); index++) {
+    add_sibling(prefixes.substr(index, 1) + "[ab]*a[ab]{8}", static_cast<int>(index));
+  }
+  add_sibling("k\\w*", 9);  // ambiguous with the one before it.
+  root.compile_dynamic_nodes();  // once, trying to build an automaton that turns out too big isn't cheap.
+  ASSERT_FALSE(root.get_dynamic_set());
+  ASSERT_TRUE(root.is_adaptive());
+
+  for (int count = 0; count < 1280; count++) {  // the order gets worked out again after 1024 matches.
+    assert_has_handler(router->resolve("/jbbbabbbbbbbb"), 7);
+    if (count % 4 == 0) assert_has_handler(router->resolve("/kzz"), 9);
+  }
+  auto order = root.dynamic_order();
+  ASSERT_EQ(order.front(), 7u);  // the busiest goes first.
+  ASSERT_LT(find(begin(order), end(order), 8) - begin(order), find(begin(order), end(order), 9) - begin(order));
+
+  auto frozen = router->freeze();
+  vector<const Router<int>*> routers{router.get(), &frozen};
+  for (auto current : routers) {
+    assert_has_handler(current->resolve("/kabbbbbbbb"), 8);
+    assert_has_handler(current->resolve("/kzz"), 9);
+    assert_has_handler(current->resolve("/caaaaaaaaaa"), 0);
+    ASSERT_FALSE(current->resolve("/zzz").matched);
+  }
+
+  router->set_adaptive(false);
+  order = root.dynamic_order();
+  ASSERT_TRUE(is_sorted(begin(order), end(order)));
+}
+
+constexpr StaticRoute<int> static_routes[] = {
+  {"/", 1},
+  {"/users/<int:id>", 2},
+  {"/users/me", 3},
+  {GET, "/users/<int:id>/posts", 4},
+  {POST, "/users/<int:id>/posts", 5},
+  {"/users/<slug:name>/posts", 6},
+  {"/static/<path:file>", 7},
+  {"/static/favicon", 8},
+};
+constexpr auto static_table = make_static_routes(static_routes);
+static_assert(static_table.size() == 8);
+static_assert(static_table[3].handler == 4);
+
+TEST_F(Networking_RouterTests, StaticRouter) {
+  router->add_route("/files/<re:(\\w*)-(\\d*):name:year>", make_shared<int>(9));
+  router->add_route("/users/me", make_shared<int>(10));  // shadowed by the table.
+  StaticRouter current{static_table, router.get()};
+
+  assert_has_handler(current.resolve("/"), 1);
+  auto result = current.resolve("/users/42");
+  assert_has_handler(result, 2);
+  ASSERT_EQ(result.params.get_as<int64_t>("id"), 42);
+  assert_has_handler(current.resolve("/users/me"), 3);  // text first, whatever the order.
+
+  assert_has_handler(current.resolve(GET, "/users/42/posts"), 4);
+  assert_has_handler(current.resolve(POST, "/users/42/posts"), 5);
+  result = current.resolve(PUT, "/users/42/posts");
+  ASSERT_TRUE(result.method_not_allowed());
+  ASSERT_EQ(result.allowed.to_string(), "GET, POST");
+  ASSERT_TRUE(result.params.empty());  // no route, no params.
+  result = current.resolve(GET, "/users/someone/posts");  // not an int, moves on to the slug.
+  assert_has_handler(result, 6);
+  ASSERT_EQ(result.params.size(), 1u);
+  ASSERT_EQ(result.params["name"], "someone");
+
+  result = current.resolve("/static/css//site.css");
+  assert_has_handler(result, 7);
+  ASSERT_EQ(result.params["file"], "css//site.css");
+  assert_has_handler(current.resolve("/static/favicon"), 8);
+  assert_has_handler(current.resolve("/static/favicon/other"), 7);
+
+  result = current.resolve("/files/report-2019");  // left to the graph.
+  assert_has_handler(result, 9);
+  ASSERT_EQ(result.params["year"], "2019");
+  ASSERT_FALSE(current.resolve("/users").matched);
+  StaticRouter without_fallback{static_table};
+  ASSERT_FALSE(without_fallback.resolve("/files/report-2019").matched);
+
+  RouteParams params;
+  HttpMethods allowed;
+  auto handler = static_table.find(GET, "/users/7/posts", params, allowed);
+  ASSERT_EQ(handler, &static_table[3].handler);  // no copies, no shared_ptr.
+  ASSERT_EQ(params.get_as<int64_t>("id"), 7);
+
+  // a graph settles each segment on the first child that matches it, the table ranks whole routes and moves on.
+  StaticRoute<int> diverging[] = {{"/u/<:v>/<int:a>", 1}, {"/u/<int:i>/b", 2}};
+  auto diverging_table = make_static_routes(diverging);
+  StaticRouter diverging_router{diverging_table};
+  GraphRouter<int> graph;
+  graph.add_route("/u/<:v>/<int:a>", make_shared<int>(1));
+  graph.add_route("/u/<int:i>/b", make_shared<int>(2));
+  ASSERT_FALSE(graph.resolve("/u/1/b").matched);  // went down <:v>, "b" is no int.
+  result = diverging_router.resolve("/u/1/b");
+  assert_has_handler(result, 2);
+  ASSERT_EQ(result.params["i"], "1");
+  assert_has_handler(graph.resolve("/u/1/2"), 1);
+  assert_has_handler(diverging_router.resolve("/u/1/2"), 1);
+
+  StaticRoute<int> invalid[] = {{"/files/<re:\\d+:id>", 1}};
+  ASSERT_THROW(make_static_routes(invalid), invalid_argument);
+  StaticRoute<int> twice[] = {{"/a/<:b>", 1}, {"a/<:b>/", 2}};
+  ASSERT_THROW(make_static_routes(twice), invalid_argument);
+  StaticRoute<int> after_path[] = {{"/a/<path:b>/c", 1}};
+  ASSERT_THROW(make_static_routes(after_path), invalid_argument);
+}
+
+TEST_F(Networking_RouterTests, BulkRoutes) {
+  istringstream input{
+    "# tenants, caf\xc3\xa9\n"
+    "GET /tenants/acme/users/<int:id> get_user\n"
+    "POST\t/tenants/acme/users/<int:id>  update_user  update\n"
+    "\n"
+    "/tenants/globex/users/<int:id> get_user\r\n"
+    "/robots.txt files\n"
+    "/v/<re:([a-z]+-\\d{2}|x\\.y):code> files\n"
+  };
+  map<string, shared_ptr<int>, less<>> handlers{
+    {"get_user", make_shared<int>(1)}, {"update_user", make_shared<int>(2)}, {"files", make_shared<int>(3)},
+  };
+  auto lookup = [&handlers](string_view name) -> shared_ptr<int> {
+    auto it = handlers.find(name);
+    return it != end(handlers) ? it->second : nullptr;
+  };
+  ASSERT_EQ(router->add_routes(input, lookup), 5u);
+
+  assert_has_handler(router->resolve(GET, "/tenants/acme/users/1"), 1);
+  assert_has_handler(router->resolve(POST, "/tenants/acme/users/1"), 2);
+  assert_has_handler(router->resolve("/tenants/globex/users/1"), 1);
+  assert_has_handler(router->resolve("/robots.txt"), 3);
+  auto result = router->resolve("/v/ab-12");
+  assert_has_handler(result, 3);
+  ASSERT_EQ(result.params["code"], "ab-12");
+  assert_has_handler(router->resolve("/v/x.y"), 3);
+  ASSERT_FALSE(router->resolve("/v/xzy").matched);
+  auto& tenants = *router->get_root().get_static_node("tenants");
+  auto& acme = *tenants.get_static_node("acme")->get_static_node("users");
+  auto& globex = *tenants.get_static_node("globex")->get_static_node("users");
+  ASSERT_EQ(acme.dynamic_nodes.front().node->name, "update");
+  ASSERT_EQ(acme.dynamic_nodes.front().matcher, globex.dynamic_nodes.front().matcher);  // one <int:id> for both.
+
+  vector<GraphRouter<int>::route_entry> entries{{nullopt, "/a/<slug:name>", make_shared<int>(4), ""}};
+  router->add_routes(begin(entries), end(entries));
+  assert_has_handler(router->resolve("/a/some-thing"), 4);
+
+  for (auto text : {"GET /b get_user\nFETCH /c get_user\n", "/b missing\n", "/b\n", "/b/<int:i<d> files\n"}) {
+    istringstream malformed{text};
+    ASSERT_THROW(router->add_routes(malformed, lookup), invalid_argument) << text;
+  }
+  ASSERT_FALSE(router->resolve("/b").matched);  // nothing of a malformed text gets added.
+  ASSERT_THROW(router->add_route("/b/<int:id>x", make_shared<int>(5)), invalid_argument);
+  ASSERT_THROW(router->add_route("/b/c d", make_shared<int>(5)), invalid_argument);
+}
+
+TEST_F(Networking_RouterTests, StaticSegments) {
+  // the unreserved characters of URLs make static segments, the ones of [\w\d] always did.
+  router->add_route("/v1.2/my-file_name~old", make_shared<int>(1));
+  router->add_route("/v1.2/<:name>", make_shared<int>(2));
+  assert_has_handler(router->resolve("/v1.2/my-file_name~old"), 1);
+  assert_has_handler(router->resolve("/v1.2/other"), 2);
+  auto version = router->get_root().get_static_node("v1.2");
+  ASSERT_TRUE(version);
+  ASSERT_TRUE(version->get_static_node("my-file_name~old"));
+  ASSERT_EQ(version->dynamic_nodes.size(), 1u);
+  for (auto path : {"/a+b", "/a%20b", "/a:b", "/caf\xc3\xa9"}) {  // anything else has to be a matcher.
+    ASSERT_THROW(router->add_route(path, make_shared<int>(3)), invalid_argument) << path;
+  }
+}
+
+TEST_F(Networking_RouterTests, Snapshot) {
+  suspiria::utility::registry<shared_ptr<int>> handlers;
+  for (int index = 1; index <= 5; index++) handlers.add("handler" + to_string(index), make_shared<int>(index));
+  auto handler = [&handlers](int index) { return handlers["handler" + to_string(index)]; };
+  for (auto tenant : {"acme", "globex", "initech"}) {  // the same matchers under every tenant share one automaton.
+    auto prefix = "/tenants/"s + tenant;
+    router->add_route(prefix, handler(1));
+    router->add_route(prefix + "/users/<int:id>", handler(2));
+    router->add_route(prefix + "/users/<slug:name>", handler(3));
+    router->add_route(GET, prefix + "/files/<path:rest>", handler(4));
+    router->add_route(PUT, prefix + "/files/<path:rest>", handler(5));
+  }
+  router->add_route_matcher_alias("even", [](RouteMatcherArgs&& args) {
+    return make_shared<RegexRouteMatcher>("(\\d*[02468])", vector<string>{args.at(0)});
+  });
+  router->add_route("/even/<even:number>", handler(1));
+  router->add_route("/<re:v(\\d+):version>/users", handler(2));
+  auto file = ::testing::TempDir() + "routes.snapshot";
+  router->save(file, [](const shared_ptr<int>& handler) { return "handler" + to_string(*handler); });
+
+  GraphRouter<int> matchers;
+  ASSERT_THROW(FrozenRouter<int>::load(file, handlers, matchers), suspiria::RegistryNotFound);  // no "even" there.
+  matchers.add_route_matcher_alias("even", [](RouteMatcherArgs&& args) {
+    return make_shared<RegexRouteMatcher>("(\\d*[02468])", vector<string>{args.at(0)});
+  });
+  auto loaded = FrozenRouter<int>::load(file, handlers, matchers);
+  ASSERT_EQ(loaded.size(), router->freeze().size());
+  for (auto& path : {"/", "/tenants", "/tenants/acme", "/tenants/globex/users/12", "/tenants/initech/users/some-one",
+                     "/tenants/acme/users/x.y", "/tenants/acme/files/a/b/c.txt", "/tenants/nobody", "/even/12",
+                     "/even/13", "/v2/users", "/v2/others"}) {
+    for (auto method : {GET, PUT, POST}) {
+      auto expected = router->resolve(method, path);
+      auto result = loaded.resolve(method, path);
+      ASSERT_EQ(result.matched, expected.matched) << path;
+      ASSERT_EQ(result.handler, expected.handler) << path;  // bound to the very handlers of the registry.
+      ASSERT_EQ(result.params, expected.params) << path;
+      ASSERT_EQ(result.allowed, expected.allowed) << path;
+    }
+  }
+  auto copy = loaded;  // copies share the mapped file.
+  loaded = router->freeze();
+  assert_has_handler(copy.resolve(PUT, "/tenants/acme/files/x"), 5);
+
+  string saved;
+  {
+    ifstream in{file, ios::binary};
+    saved.assign(istreambuf_iterator<char>{in}, {});
+  }
+  router->save(file, [](const shared_ptr<int>& handler) { return "handler" + to_string(*handler); });
+  {
+    ifstream in{file, ios::binary};
+    ASSERT_EQ(string(istreambuf_iterator<char>{in}, {}), saved);  // nothing but the routes, no stray padding.
+  }
+  suspiria::utility::registry<shared_ptr<int>> missing;
+  missing.add("handler1", make_shared<int>(1));
+  ASSERT_THROW(FrozenRouter<int>::load(file, missing, matchers), suspiria::RegistryNotFound);
+  ASSERT_THROW(FrozenRouter<int>::load(file + ".none", handlers), system_error);
+  {
+    ofstream out{file, ios::binary | ios::trunc};
+    out << "not a snapshot of routes, just some text that is long enough to have a header's worth of bytes";
+  }
+  ASSERT_THROW(FrozenRouter<int>::load(file, handlers), runtime_error);
+  std::remove(file.c_str());
+}
+
+TEST_F(Networking_RouterTests, CorruptSnapshot) {
+  suspiria::utility::registry<shared_ptr<int>> handlers;
+  handlers.add("one", make_shared<int>(1));
+  router->add_route("/users/<int:id>", handlers["one"]);
+  router->add_route("/users/<slug:name>/posts", handlers["one"]);
+  router->add_route(GET, "/files/<path:rest>", handlers["one"]);
+  auto file = ::testing::TempDir() + "corrupt.snapshot";
+  router->save(file, [](const shared_ptr<int>&) { return "one"s; });
+  string saved;
+  {
+    ifstream in{file, ios::binary};
+    saved.assign(istreambuf_iterator<char>{in}, {});
+  }
+
+  // indices are little endian 32 bit words, flipping the top bit of each one points it far out of its array.
+  size_t corrupt = 0;
+  for (size_t position = 3; position < saved.size(); position += 4) {
+    auto damaged = saved;
+    damaged[position] = static_cast<char>(damaged[position] ^ 0x80);
+    {
+      ofstream out{file, ios::binary | ios::trunc};
+      out << damaged;
+    }
+    try {
+      auto loaded = FrozenRouter<int>::load(file, handlers);
+      for (auto path : {"/users/12", "/users/some-one/posts", "/files/a/b", "/nothing"}) {
+        loaded.resolve(GET, path);  // whatever is left of the routes, resolving stays inside the image.
+      }
+    } catch (const runtime_error& error) {
+      if (string{error.what()}.find("corrupt") != string::npos) corrupt++;
+    } catch (const suspiria::RegistryNotFound&) {  // damaged names.
+    } catch (const logic_error&) {  // damaged segments of matchers.
+    }
+  }
+  ASSERT_GT(corrupt, 0u);
+  std::remove(file.c_str());
+}
+
+TEST_F(Networking_RouterTests, HostRouter) {
+  auto make_router = [](int handler) {
+    auto result = make_shared<GraphRouter<int>>();
+    result->add_route("/", make_shared<int>(handler));
+    result->add_route(GET, "/users/<int:id>", make_shared<int>(handler * 10));
+    return result;
+  };
+  HostRouter<int> hosts;
+  ASSERT_EQ(hosts.find("example.com"), nullptr);
+  ASSERT_FALSE(hosts.resolve("example.com", "/").matched);
+  hosts.add_host("example.com", make_router(1));
+  hosts.add_host("*.example.com", make_router(2));
+  hosts.add_host("*.eu.example.com", make_router(3));
+  hosts.add_host("api.eu.example.com:443", make_router(4));
+  hosts.add_host("[::1]", make_router(5));
+  ASSERT_EQ(hosts.size(), 5u);
+
+  assert_has_handler(hosts.resolve("example.com", "/"), 1);
+  assert_has_handler(hosts.resolve("Example.COM.:8080", "/"), 1);
+  assert_has_handler(hosts.resolve("www.example.com", "/"), 2);
+  assert_has_handler(hosts.resolve("a.b.example.com", "/"), 2);
+  assert_has_handler(hosts.resolve("eu.example.com", "/"), 2);
+  assert_has_handler(hosts.resolve("shop.eu.example.com", "/"), 3);  // the longer wildcard wins.
+  assert_has_handler(hosts.resolve("API.eu.example.com", "/"), 4);  // and an exact host wins over both.
+  assert_has_handler(hosts.resolve("[::1]:8080", "/"), 5);
+  auto result = hosts.resolve("www.example.com", GET, "/users/12");
+  assert_has_handler(result, 20);
+  ASSERT_EQ(result.params["id"], "12");
+  ASSERT_TRUE(hosts.resolve("www.example.com", POST, "/users/12").method_not_allowed());
+  for (auto host : {"", "example.org", "notexample.com", ".example.com", "example.com.evil.org", "[::2]"}) {
+    ASSERT_EQ(hosts.find(host), nullptr) << host;
+  }
+
+  hosts.set_default(make_router(6));
+  assert_has_handler(hosts.resolve("example.org", "/"), 6);
+  hosts.add_host("EXAMPLE.com", make_router(7));  // replaces the router of the host.
+  assert_has_handler(hosts.resolve("example.com", "/"), 7);
+  ASSERT_EQ(hosts.size(), 5u);
+  for (int index = 0; index < 100; index++) hosts.add_host("host" + to_string(index) + ".org", make_router(index));
+  assert_has_handler(hosts.resolve("host42.org", "/"), 42);
+  assert_has_handler(hosts.resolve("shop.eu.example.com", "/"), 3);
+  for (auto host : {"", "*.", "a.*.com", "*", ":80"}) {
+    ASSERT_THROW(hosts.add_host(host, make_router(1)), invalid_argument) << host;
+  }
+  ASSERT_THROW(hosts.add_host("example.net", nullptr), invalid_argument);
+}
@@ -53,6 +53,15 @@ TEST(UtilityTests, StringPartitioner) {
   for (auto i = 0; splitter.next(word); i++) {
     ASSERT_EQ(word, expectation[i]);
   }
+
+  // Views handed out by next() point into the text itself.
+  string text = "//api/v3//auth/";
+  string_partitioner view_splitter{text};
+  string_view view;
+  for (auto i = 0; view_splitter.next(view); i++) {
+    ASSERT_EQ(view, expectation[i]);
+    ASSERT_TRUE(view.data() >= text.data() && view.data() + view.size() <= text.data() + text.size());
+  }
 }
 
 